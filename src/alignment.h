@@ -0,0 +1,285 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#ifndef RMA_ALIGNMENT_H_
+#define RMA_ALIGNMENT_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "database.h"
+#include "dna_encoding.h"
+#include "querying.h"
+
+#include "../dep/edlib.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief edlib alignment container
+ *
+ *****************************************************************************/
+struct edlib_alignment {
+
+    enum struct status {FORWARD, REVERSE, UNALIGNED};
+
+    /**
+     * @param max_edit_distance  < 0: automatic bound of 'error_rate' * read
+     *                           length that is doubled until an alignment is
+     *                           found; unbounded if 'error_rate' is not > 0
+     */
+    edlib_alignment(const std::string& query, target_id tgt, const database& db,
+                    int max_edit_distance, double error_rate = 0):
+        tgt_(tgt), status_(status::UNALIGNED), score_(query.size()), cigar_(nullptr)
+    {
+        // missing mate (single-end reads); edlib doesn't terminate on empty queries
+        if (query.empty()) return;
+
+        const std::string& target = db.get_target(tgt).seq();
+        const std::string reverse_query = make_reverse_complement(query);
+
+        const int queryLen = int(query.size());
+        bool widen = false;
+        if (max_edit_distance < 0 && error_rate > 0) {
+            max_edit_distance = std::min(queryLen, std::max(min_auto_edit_distance(),
+                                    int(std::ceil(error_rate * queryLen))));
+            widen = true;
+        }
+
+        EdlibAlignResult regular, reverse_complement;
+        for (;;) {
+            auto edlib_config = edlibNewAlignConfig(max_edit_distance, EDLIB_MODE_HW, EDLIB_TASK_PATH, additionalEqualities.data(), additionalEqualities.size());
+
+            regular = edlibAlign(query.c_str(), query.size(), target.c_str(), target.size(), edlib_config);
+            reverse_complement = edlibAlign(reverse_query.c_str(), reverse_query.size(), target.c_str(), target.size(), edlib_config);
+
+            if (regular.status != EDLIB_STATUS_OK || reverse_complement.status != EDLIB_STATUS_OK) {
+                edlibFreeAlignResult(regular);
+                edlibFreeAlignResult(reverse_complement);
+                throw std::runtime_error{"edlib failed!"};
+            }
+            // edit distance can't exceed read length => bound >= length is exact
+            if (!widen || max_edit_distance >= queryLen ||
+                regular.editDistance >= 0 || reverse_complement.editDistance >= 0)
+            {
+                break;
+            }
+            // no alignment within band => double band width
+            edlibFreeAlignResult(regular);
+            edlibFreeAlignResult(reverse_complement);
+            max_edit_distance = std::min(queryLen, 2 * max_edit_distance);
+        }
+
+        // keep in mind ../dep/edlip.cpp:212
+        // start loc is always on reference, but end can be negative
+        if (regular.editDistance >= 0 && regular.endLocations[0] >= 0 &&
+           (reverse_complement.editDistance < 0 || reverse_complement.endLocations[0] < 0 ||
+            reverse_complement.editDistance >= regular.editDistance))
+        {
+            status_ = status::FORWARD;
+            start_ = regular.startLocations[0];
+            end_ = regular.endLocations[0];
+            score_ = regular.editDistance;
+            cigar_ = edlibAlignmentToCigar(regular.alignment, regular.alignmentLength, EDLIB_CIGAR_STANDARD);
+        } 
+        else if (reverse_complement.editDistance >= 0 && reverse_complement.endLocations[0] >= 0)
+        {
+            status_ = status::REVERSE;
+            start_ = reverse_complement.startLocations[0];
+            end_ = reverse_complement.endLocations[0];
+            score_ = reverse_complement.editDistance;
+            cigar_ = edlibAlignmentToCigar(reverse_complement.alignment, reverse_complement.alignmentLength, EDLIB_CIGAR_STANDARD);
+        }
+        edlibFreeAlignResult(regular);
+        edlibFreeAlignResult(reverse_complement);
+    }
+
+    edlib_alignment(const edlib_alignment&) = delete;
+    edlib_alignment& operator=(const edlib_alignment&) = delete;
+    edlib_alignment& operator=(edlib_alignment&&) = delete;
+    
+    edlib_alignment(edlib_alignment&& other):
+        tgt_(other.tgt_), status_(other.status_), score_(other.score_), start_(other.start_), end_(other.end_), cigar_(other.cigar_)
+    {
+        other.cigar_ = nullptr;
+    }
+
+    ~edlib_alignment() {free(cigar_);}
+
+    bool aligned() const noexcept {return status_!=status::UNALIGNED;}
+    int score() const noexcept {return score_;}
+    status orientation() const noexcept {return status_;}
+    target_id tgt() const noexcept {return tgt_;}
+    int start() const noexcept {return start_;}
+    int end() const noexcept {return end_;}
+    const char * cigar() const noexcept {return cigar_;}
+
+    /// @brief smallest automatic edit distance bound
+    static constexpr int min_auto_edit_distance() noexcept { return 8; }
+
+private:
+    inline static std::vector<EdlibEqualityPair> additionalEqualities{
+        {'a', 'A'}, {'t', 'T'}, {'c', 'C'}, {'g', 'G'}};
+    target_id tgt_;
+    status status_;
+    int score_;
+    int start_, end_;
+    char * cigar_;
+};
+
+struct edlib_alignment_pair {
+    edlib_alignment_pair(const sequence_query& query, target_id tgt, const database& db,
+                         int max_edit_distance, double error_rate = 0):
+        first(query.seq1, tgt, db, max_edit_distance, error_rate),
+        second(query.seq2, tgt, db, max_edit_distance, error_rate)
+    {}
+
+    bool aligned() const noexcept {return first.aligned() || second.aligned();}
+    int score() const noexcept {return first.score() + second.score();}
+    target_id tgt() const noexcept {return first.tgt();};
+
+    edlib_alignment first, second;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief expected number of sketch hits that are lost per edit operation:
+ *        an edit changes up to k k-mers, of which a fraction of
+ *        (sketch size / k-mers per window) is part of the sketches
+ *
+ *****************************************************************************/
+inline double
+expected_hits_per_edit(const database& db)
+{
+    const auto& sk = db.query_sketcher();
+    const double kmers = std::max(1.0,
+        double(sk.window_size()) - double(sk.kmer_size()) + 1);
+    return std::min(double(sk.sketch_size()),
+                    sk.kmer_size() * double(sk.sketch_size()) / kmers);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief aligns candidates and removes the ones that could not be aligned;
+ *        alignments are stored in the same order as the remaining candidates
+ *
+ *        Lazy mode ('lazyAlign'): Candidates are aligned in descending
+ *        hit order. Alignment stops as soon as the hit deficit of the next
+ *        candidate (relative to the best alignment so far) corresponds to
+ *        more than 'alignScoreGap' expected edits. Edlib is limited to the
+ *        best edit distance + gap; alignments exceeding that are removed.
+ *
+ * @return index of primary (lowest edit distance) alignment
+ *
+ *****************************************************************************/
+inline std::size_t
+make_candidate_alignments(const database& db,
+                          const classification_options& opt,
+                          const sequence_query& query,
+                          classification_candidates& cands,
+                          std::vector<edlib_alignment_pair>& alns)
+{
+    alns.clear();
+    std::size_t primary = 0;
+
+    if (!opt.lazyAlign) {
+        cands.erase(std::remove_if(cands.begin(), cands.end(),
+            [&](const match_candidate& cand) {
+                alns.emplace_back(query, cand.tgt, db, opt.maxEditDist,
+                                  opt.alignErrorRate);
+                if (!alns.back().aligned()) {
+                    alns.pop_back();
+                    return true;
+                } else if (alns.back().score() < alns[primary].score()) {
+                    primary = alns.size()-1;
+                }
+                return false;
+            }), cands.end());
+
+        return primary;
+    }
+
+    // visit candidates in descending hit order
+    std::vector<std::size_t> order(cands.size());
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::stable_sort(order.begin(), order.end(),
+        [&](std::size_t a, std::size_t b) { return cands[a].hits > cands[b].hits; });
+
+    const double maxHitsDeficit = opt.alignScoreGap * expected_hits_per_edit(db);
+
+    std::vector<std::optional<edlib_alignment_pair>> slots(cands.size());
+    int best = -1;
+    double bestHits = 0;
+
+    for (auto i : order) {
+        const auto& cand = cands[i];
+        if (best >= 0 && bestHits - cand.hits > maxHitsDeficit) break;
+
+        int maxEdit = opt.maxEditDist;
+        if (best >= 0) {
+            const int limit = best + opt.alignScoreGap;
+            if (maxEdit < 0 || limit < maxEdit) maxEdit = limit;
+        }
+
+        auto& aln = slots[i];
+        aln.emplace(query, cand.tgt, db, maxEdit, opt.alignErrorRate);
+        if (!aln->aligned()) {
+            aln.reset();
+        }
+        else if (best < 0 || aln->score() < best) {
+            best = aln->score();
+            bestHits = cand.hits;
+        }
+    }
+
+    std::size_t k = 0;
+    cands.erase(std::remove_if(cands.begin(), cands.end(),
+        [&](const match_candidate&) {
+            auto& aln = slots[k++];
+            if (!aln || aln->score() > best + opt.alignScoreGap) return true;
+            alns.push_back(std::move(*aln));
+            if (alns.back().score() < alns[primary].score()) {
+                primary = alns.size()-1;
+            }
+            return false;
+        }), cands.end());
+
+    return primary;
+}
+
+
+} // namespace mc
+
+
+#endif
@@ -2,9 +2,15 @@
 #define BATCH_PROCESSING_H_
 
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <functional>
 #include <atomic>
 #include <future>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
 #include "../dep/queue/concurrentqueue.h"
 
@@ -13,6 +19,43 @@ namespace mc {
 
 // forward declarations
 template<class WorkItem> class batch_executor;
+template<class WorkItem> class work_stealing_executor;
+
+
+
+/*************************************************************************//**
+ *
+ * @brief threads shared by several concurrently running executors;
+ *        executors take over threads that other executors have released
+ *
+ *****************************************************************************/
+class thread_budget {
+public:
+    /**
+     * @param available  number of threads that can be taken right away
+     * @param capacity   max. number of threads one executor can take
+     */
+    thread_budget(int available, int capacity) noexcept:
+        free_{std::max(0, available)}, capacity_{std::max(0, capacity)}
+    {}
+
+    int capacity() const noexcept { return capacity_; }
+
+    bool try_acquire() noexcept {
+        int n = free_.load();
+        while (n > 0) {
+            if (free_.compare_exchange_weak(n, n - 1)) return true;
+        }
+        return false;
+    }
+
+    void release() noexcept { ++free_; }
+
+private:
+    std::atomic<int> free_;
+    const int capacity_;
+};
+
 
 /*************************************************************************//**
  *
@@ -22,6 +65,7 @@ template<class WorkItem> class batch_executor;
 class batch_processing_options {
 public:
     template<class T> friend class batch_executor;
+    template<class T> friend class work_stealing_executor;
 
     using error_handler   = std::function<void(std::exception&)>;
     using abort_condition = std::function<bool()>;
@@ -31,6 +75,10 @@ public:
         numWorkers_{0},
         queueSize_{1},
         batchSize_{1},
+        splitSize_{0},
+        autoTune_{false},
+        memoryLimit_{0},
+        sharedThreads_{nullptr},
         handleErrors_{[](std::exception&){}},
         abortRequested_{[]{ return false; }},
         finalize_{[]{}}
@@ -44,6 +92,31 @@ public:
     void batch_size(std::size_t n) noexcept { batchSize_  = n > 0 ? n : 1; }
     void queue_size(std::size_t n) noexcept { queueSize_  = n > 0 ? n : 1; }
 
+    /** @brief smallest part of a batch that is processed at once
+     *         (only used by work_stealing_executor; 0 : batch size / 16)
+     */
+    std::size_t split_size() const noexcept { return splitSize_; }
+    void split_size(std::size_t n) noexcept { splitSize_ = n; }
+
+    /** @brief adapt batch size and number of batches in flight at runtime
+     *         (only used by work_stealing_executor)
+     */
+    bool auto_tune() const noexcept { return autoTune_; }
+    void auto_tune(bool yes) noexcept { autoTune_ = yes; }
+
+    /** @brief memory budget for all batches in bytes (0 : no limit);
+     *         only used for auto tuning
+     */
+    std::size_t memory_limit() const noexcept { return memoryLimit_; }
+    void memory_limit(std::size_t bytes) noexcept { memoryLimit_ = bytes; }
+
+    /** @brief workers are taken from (and returned to) a shared budget;
+     *         more workers are added while the budget has free threads
+     *         (only used by work_stealing_executor; nullptr : no sharing)
+     */
+    thread_budget* shared_threads() const noexcept { return sharedThreads_; }
+    void shared_threads(thread_budget* b) noexcept { sharedThreads_ = b; }
+
     void on_work_done(finalizer f)   { finalize_ = std::move(f); }
     void on_error(error_handler f)   { handleErrors_ = std::move(f); }
     void abort_if (abort_condition f) { abortRequested_ = std::move(f); }
@@ -52,6 +125,10 @@ private:
     int numWorkers_;
     std::size_t queueSize_;
     std::size_t batchSize_;
+    std::size_t splitSize_;
+    bool autoTune_;
+    std::size_t memoryLimit_;
+    thread_budget* sharedThreads_;
     error_handler handleErrors_;
     abort_condition abortRequested_;
     finalizer finalize_;
@@ -238,6 +315,511 @@ private:
 };
 
 
+
+/*************************************************************************//**
+ *
+ * @brief  parallel batch processing with per-worker task deques
+ *         and work stealing;
+ *         batches are split into parts (of at least 'split_size' items)
+ *         while other workers are idle, so that all workers stay busy
+ *         until the last batch is finished;
+ *         the producer thread helps processing batches instead of waiting
+ *         for free batch storage;
+ *         runs sequentially if concurrency is set to 0 (and there are
+ *         no shared threads to take over)
+ *
+ *         With auto tuning the batch size is chosen such that processing
+ *         a batch takes about 'target_batch_time' on one thread and
+ *         more batches are put in flight if the queues run empty and full
+ *         in turns; both within the memory limit.
+ *
+ *         The consumer is called for parts [first,last) of batches;
+ *         parts of the same batch can be processed concurrently.
+ *
+ * @tparam WorkItem
+ *
+ *****************************************************************************/
+template<class WorkItem>
+class work_stealing_executor
+{
+public:
+
+    using batch_type      = std::vector<WorkItem>;
+    using range_consumer  = std::function<void(int,batch_type&,std::size_t,std::size_t)>;
+    using error_handler   = batch_processing_options::error_handler;
+    using abort_condition = batch_processing_options::abort_condition;
+    using finalizer       = batch_processing_options::finalizer;
+    using item_memory_estimator = std::function<std::size_t(const WorkItem&)>;
+
+    static constexpr std::chrono::nanoseconds target_batch_time() noexcept {
+        return std::chrono::milliseconds{32};
+    }
+
+private:
+    static constexpr std::size_t min_tuned_batch_size = 64;
+    static constexpr std::size_t max_tuned_batch_size = std::size_t(1) << 16;
+    // number of submitted batches between tuning steps
+    static constexpr std::size_t tuning_interval = 4;
+
+    // part of a batch
+    struct task {
+        std::size_t slot = 0;
+        std::size_t first = 0;
+        std::size_t last = 0;
+        std::size_t size() const noexcept { return last - first; }
+    };
+
+    struct batch_slot {
+        batch_type batch;
+        std::atomic<std::size_t> unfinished{0};
+        std::size_t partSize = 1;
+    };
+
+    struct task_deque {
+        std::mutex mtx;
+        std::deque<task> tasks;
+    };
+
+public:
+    // -----------------------------------------------------------------------
+    /**
+     * @param consume  processes the items [first,last) of a batch
+     */
+    work_stealing_executor(batch_processing_options opt,
+                           range_consumer consume)
+    :
+        param_{std::move(opt)},
+        keepWorking_{true},
+        slots_{}, freeSlots_{}, activeSlots_{0},
+        currentSlot_{0}, currentWorkCount_{0}, currentLimit_{0},
+        hasCurrent_{false},
+        batchSize_{param_.batch_size()},
+        maxWorkers_{0}, numWorkers_{0},
+        queues_{}, nextQueue_{0}, pending_{0}, queued_{0}, idle_{0},
+        wakeMtx_{}, wakeUp_{}, producerWakeUp_{},
+        consume_{std::move(consume)},
+        itemMemory_{}, itemBytes_{0},
+        busyNanos_{0}, itemsDone_{0}, submitted_{0}, stalls_{0}, starved_{0},
+        workers_{}
+    {
+        auto budget = param_.shared_threads();
+        maxWorkers_ = budget ? std::max(param_.concurrency(), budget->capacity())
+                             : param_.concurrency();
+
+        activeSlots_ = maxWorkers_ > 0 ? param_.queue_size() : 1;
+
+        // auto tuning may put more batches in flight later
+        const auto numSlots = tuning() ? 4 * activeSlots_ : activeSlots_;
+
+        for (std::size_t i = 0; i < numSlots; ++i) {
+            slots_.push_back(std::make_unique<batch_slot>());
+        }
+        for (std::size_t i = 0; i < activeSlots_; ++i) {
+            slots_[i]->batch.resize(batchSize_);
+            freeSlots_.enqueue(i);
+        }
+
+        if (maxWorkers_ > 0) {
+            // one deque per (possible) worker + one for the producer thread
+            for (int i = 0; i <= maxWorkers_; ++i) {
+                queues_.push_back(std::make_unique<task_deque>());
+            }
+
+            workers_.reserve(maxWorkers_);
+            for (int i = 0; i < param_.concurrency(); ++i) {
+                if (budget && !budget->try_acquire()) break;
+                add_worker();
+            }
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    ~work_stealing_executor() {
+        try {
+            submit_current_batch();
+
+            if (numWorkers_.load() < 1) {
+                param_.finalize_();
+            }
+            else {
+                // help until no work is left
+                help_until([&] { return pending_.load() < 1; });
+                // signal all workers to finish
+                {
+                    std::lock_guard<std::mutex> lock(wakeMtx_);
+                    keepWorking_.store(false);
+                    wakeUp_.notify_all();
+                }
+                for (auto& worker : workers_) {
+                    if (worker.valid()) worker.get();
+                }
+            }
+        }
+        catch(std::exception& e) {
+            param_.handleErrors_(e);
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    const batch_processing_options&
+    param() const noexcept {
+        return param_;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @return false, if abort condition was met or destruction in progress */
+    bool valid() const noexcept {
+        return keepWorking_.load();
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @return current number of work items per batch */
+    std::size_t batch_size() const noexcept { return batchSize_; }
+
+    /** @return current number of batch storage slots */
+    std::size_t batches_in_flight() const noexcept { return activeSlots_; }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief sets function that estimates the memory used by a work item
+     *         (used to keep batches within the memory limit)
+     */
+    void item_memory(item_memory_estimator f) {
+        itemMemory_ = std::move(f);
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief  get reference to next work item */
+    WorkItem& next_item() {
+        if (hasCurrent_ && currentWorkCount_ >= currentLimit_) {
+            submit_current_batch();
+        }
+
+        if (!hasCurrent_) {
+            // get free batch storage; help processing while there is none
+            if (!freeSlots_.try_dequeue(currentSlot_)) {
+                ++stalls_;
+                help_until([&] { return freeSlots_.try_dequeue(currentSlot_); });
+            }
+
+            auto& batch = slots_[currentSlot_]->batch;
+            if (batch.size() < batchSize_) batch.resize(batchSize_);
+            currentLimit_ = batchSize_;
+            currentWorkCount_ = 0;
+            hasCurrent_ = true;
+        }
+
+        return slots_[currentSlot_]->batch[currentWorkCount_++];
+    }
+
+
+    // -----------------------------------------------------------------------
+    /**
+     * @brief  hands over the current (partial) batch and blocks until
+     *         all batches handed over so far have been processed
+     */
+    void wait_until_idle() {
+        submit_current_batch();
+        help_until([&] { return pending_.load() < 1; });
+    }
+
+
+private:
+    // -----------------------------------------------------------------------
+    /** @brief called by producer only */
+    void add_worker() {
+        const int i = int(workers_.size());
+        workers_.emplace_back(std::async(std::launch::async, [&,i] {
+            validate();
+            while (valid() || pending_.load() > 0) {
+                task t;
+                if (pop_task(i, t)) {
+                    run(i, t);
+                }
+                else {
+                    // sleep until there are tasks or nothing is left to do
+                    std::unique_lock<std::mutex> lock(wakeMtx_);
+                    ++idle_;
+                    wakeUp_.wait(lock, [&] {
+                        return queued_.load() > 0 ||
+                               (!valid() && pending_.load() < 1);
+                    });
+                    --idle_;
+                }
+                validate();
+            }
+            param_.finalize_();
+            if (param_.shared_threads()) param_.shared_threads()->release();
+        }));
+        ++numWorkers_;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief takes over threads released by other executors */
+    void grow() {
+        auto budget = param_.shared_threads();
+        if (!budget) return;
+        while (int(workers_.size()) < maxWorkers_ && budget->try_acquire()) {
+            add_worker();
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    void submit_current_batch() {
+        if (!hasCurrent_) return;
+        hasCurrent_ = false;
+
+        auto& slot = *slots_[currentSlot_];
+
+        if (currentWorkCount_ < 1) {
+            freeSlots_.enqueue(currentSlot_);
+            return;
+        }
+
+        const task t {currentSlot_, 0, currentWorkCount_};
+        slot.unfinished.store(t.size());
+        slot.partSize = param_.split_size() > 0 ? param_.split_size()
+                                                : std::max(std::size_t(1), currentLimit_ / 16);
+
+        if (tuning()) tune(slot.batch, t.size());
+
+        grow();
+
+        // sequential processing
+        if (numWorkers_.load() < 1) {
+            validate();
+            if (valid()) run(0, t);
+            validate();
+            if (!valid()) param_.finalize_();
+            return;
+        }
+
+        pending_ += t.size();
+        push_task(nextQueue_, t);
+        nextQueue_ = (nextQueue_ + 1) % numWorkers_.load();
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief producer processes tasks until 'done' returns true;
+     *         sleeps while there are no tasks
+     */
+    template<class Condition>
+    void help_until(Condition&& done) {
+        const int self = maxWorkers_;
+        while (!done()) {
+            task t;
+            if (numWorkers_.load() > 0 && pop_task(self, t)) {
+                run(self, t);
+            } else {
+                // 'done' may have side effects => must not be called again
+                bool finished = false;
+                std::unique_lock<std::mutex> lock(wakeMtx_);
+                producerWakeUp_.wait(lock, [&] {
+                    return queued_.load() > 0 || (finished = done());
+                });
+                if (finished) return;
+            }
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    void push_task(int q, const task& t) {
+        {
+            std::lock_guard<std::mutex> lock(queues_[q]->mtx);
+            queues_[q]->tasks.push_back(t);
+        }
+        std::lock_guard<std::mutex> lock(wakeMtx_);
+        ++queued_;
+        wakeUp_.notify_one();
+        producerWakeUp_.notify_one();
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief takes newest task from own deque or steals oldest from others */
+    bool pop_task(int self, task& t) {
+        {
+            auto& q = *queues_[self];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            if (!q.tasks.empty()) {
+                t = q.tasks.back();
+                q.tasks.pop_back();
+                --queued_;
+                return true;
+            }
+        }
+        const int n = int(queues_.size());
+        for (int i = 1; i < n; ++i) {
+            auto& q = *queues_[(self + i) % n];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            if (!q.tasks.empty()) {
+                t = q.tasks.front();
+                q.tasks.pop_front();
+                --queued_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief processes task in parts; splits off the back half
+     *         of the remaining items while other workers are idle
+     */
+    void run(int self, task t) {
+        // no need to split batches if there is only one thread
+        const bool parallel = numWorkers_.load() > 0;
+        const auto part = parallel ? slots_[t.slot]->partSize : t.size();
+
+        while (t.size() > 0) {
+            if (parallel && idle_.load() > 0 && t.size() >= 2 * part) {
+                const auto mid = t.first + t.size() / 2;
+                push_task(self, task{t.slot, mid, t.last});
+                t.last = mid;
+            }
+            const auto last = std::min(t.last, t.first + part);
+            const auto n = last - t.first;
+
+            const auto start = std::chrono::steady_clock::now();
+            try {
+                consume_(self, slots_[t.slot]->batch, t.first, last);
+            }
+            catch(std::exception& e) {
+                param_.handleErrors_(e);
+            }
+            t.first = last;
+
+            if (tuning()) {
+                busyNanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - start).count();
+                itemsDone_ += n;
+            }
+
+            // last part of batch => batch storage can be re-used
+            const bool freed = slots_[t.slot]->unfinished.fetch_sub(n) == n;
+            if (freed) freeSlots_.enqueue(t.slot);
+
+            // producer might wait for free storage or for all work to be done
+            if (parallel && ((pending_ -= n) < 1 || freed)) {
+                std::lock_guard<std::mutex> lock(wakeMtx_);
+                producerWakeUp_.notify_one();
+            }
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    bool tuning() const noexcept {
+        return param_.auto_tune() && maxWorkers_ > 0;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief adapts batch size and number of batches in flight;
+     *         called by producer for each submitted batch
+     */
+    void tune(const batch_type& batch, std::size_t n) {
+        if (itemMemory_ && n > 0) {
+            const auto bytes = itemMemory_(batch[n / 2]);
+            itemBytes_ = itemBytes_ > 0 ? (3 * itemBytes_ + bytes) / 4 : bytes;
+        }
+        // workers wait for producer
+        if (idle_.load() > 0 && pending_.load() < batchSize_) ++starved_;
+
+        if (++submitted_ % tuning_interval != 0) return;
+
+        const auto items = itemsDone_.load();
+        if (items > 0) {
+            // batch should take about 'target_batch_time' on one thread
+            const double nanosPerItem = std::max(1.0, double(busyNanos_.load()) / items);
+            batchSize_ = clamped_batch_size(
+                std::size_t(target_batch_time().count() / nanosPerItem));
+        }
+
+        const auto limit = param_.memory_limit();
+        const auto fits = [&] (std::size_t numBatches) {
+            return limit < 1 || itemBytes_ < 1 ||
+                   numBatches * batchSize_ * itemBytes_ <= limit;
+        };
+
+        // queues alternate between empty and full => buffer more batches
+        if (starved_ > 0 && stalls_ > 0 &&
+            activeSlots_ < slots_.size() && fits(activeSlots_ + 1))
+        {
+            freeSlots_.enqueue(activeSlots_++);
+        }
+        // keep within memory limit
+        while (batchSize_ > min_tuned_batch_size && !fits(activeSlots_)) {
+            batchSize_ /= 2;
+        }
+        starved_ = 0;
+        stalls_ = 0;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @return nearest power of 2 within tuning range */
+    static std::size_t clamped_batch_size(std::size_t n) noexcept {
+        std::size_t size = min_tuned_batch_size;
+        while (size < max_tuned_batch_size && size + size / 2 < n) size *= 2;
+        return size;
+    }
+
+
+    // -----------------------------------------------------------------------
+    void validate() {
+        if (param_.abortRequested_() && keepWorking_.exchange(false)) {
+            std::lock_guard<std::mutex> lock(wakeMtx_);
+            wakeUp_.notify_all();
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    const batch_processing_options param_;
+    std::atomic_bool keepWorking_;
+    std::vector<std::unique_ptr<batch_slot>> slots_;
+    moodycamel::ConcurrentQueue<std::size_t> freeSlots_;
+    std::size_t activeSlots_;
+    std::size_t currentSlot_;
+    std::size_t currentWorkCount_;
+    std::size_t currentLimit_;
+    bool hasCurrent_;
+    std::size_t batchSize_;
+    int maxWorkers_;
+    std::atomic<int> numWorkers_;
+    std::vector<std::unique_ptr<task_deque>> queues_;
+    int nextQueue_;
+    std::atomic<std::size_t> pending_;
+    // tasks in all deques
+    std::atomic<std::size_t> queued_;
+    std::atomic<int> idle_;
+    std::mutex wakeMtx_;
+    std::condition_variable wakeUp_;
+    std::condition_variable producerWakeUp_;
+    range_consumer consume_;
+    // auto tuning
+    item_memory_estimator itemMemory_;
+    std::size_t itemBytes_;
+    std::atomic<std::uint64_t> busyNanos_;
+    std::atomic<std::uint64_t> itemsDone_;
+    std::size_t submitted_;
+    std::size_t stalls_;
+    std::size_t starved_;
+    std::vector<std::future<void>> workers_;
+};
+
+
 } // namespace mc
 
 
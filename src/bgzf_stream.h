@@ -0,0 +1,169 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#ifndef RMA_BGZF_STREAM_H_
+#define RMA_BGZF_STREAM_H_
+
+#ifdef RMA_BAM
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "io_error.h"
+
+#include <bgzf.h>
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief output stream buffer that writes BGZF-compressed data
+ *        (gzip compatible, indexable) using htslib;
+ *        blocks are compressed by htslib's worker threads
+ *
+ *****************************************************************************/
+class bgzf_streambuf :
+    public std::streambuf
+{
+public:
+    //---------------------------------------------------------------
+    /**
+     * @param numThreads  compression threads (< 2: compress in caller)
+     * @throws file_write_error
+     */
+    bgzf_streambuf(const std::string& filename, int numThreads):
+        filename_{filename},
+        fp_{bgzf_open(filename.c_str(), "w")},
+        buf_(1 << 16)
+    {
+        if (!fp_) {
+            throw file_write_error{"Could not write to file " + filename};
+        }
+        if (numThreads > 1) bgzf_mt(fp_, numThreads, 64);
+        setp(buf_.data(), buf_.data() + buf_.size());
+    }
+
+    ~bgzf_streambuf() {
+        try { close(); } catch(...) {}
+    }
+
+    bgzf_streambuf(const bgzf_streambuf&) = delete;
+    bgzf_streambuf& operator = (const bgzf_streambuf&) = delete;
+
+
+    //---------------------------------------------------------------
+    /// @brief writes remaining data and EOF marker
+    void close()
+    {
+        if (!fp_) return;
+        const bool ok = write_buffer();
+        const bool closed = bgzf_close(fp_) == 0;
+        fp_ = nullptr;
+        if (!ok || !closed) {
+            throw file_write_error{"Could not write to file " + filename_};
+        }
+    }
+
+
+protected:
+    //---------------------------------------------------------------
+    int_type overflow(int_type c) override
+    {
+        if (!write_buffer()) return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    //---------------------------------------------------------------
+    std::streamsize xsputn(const char* s, std::streamsize n) override
+    {
+        // large writes bypass buffer
+        if (n >= std::streamsize(buf_.size())) {
+            if (!write_buffer()) return 0;
+            return bgzf_write(fp_, s, std::size_t(n)) < 0 ? 0 : n;
+        }
+        return std::streambuf::xsputn(s, n);
+    }
+
+    //---------------------------------------------------------------
+    /// @brief hands buffered data over to BGZF; doesn't force a block end
+    int sync() override {
+        return write_buffer() ? 0 : -1;
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    bool write_buffer()
+    {
+        if (!fp_) return false;
+        const auto n = pptr() - pbase();
+        setp(buf_.data(), buf_.data() + buf_.size());
+        return n < 1 || bgzf_write(fp_, buf_.data(), std::size_t(n)) >= 0;
+    }
+
+    std::string filename_;
+    BGZF* fp_;
+    std::vector<char> buf_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief BGZF-compressed output file stream
+ *
+ *****************************************************************************/
+class bgzf_ostream :
+    public std::ostream
+{
+public:
+    bgzf_ostream(const std::string& filename, int numThreads):
+        std::ostream{nullptr}, buf_{filename, numThreads}
+    {
+        rdbuf(&buf_);
+    }
+
+    /// @throws file_write_error
+    void close() {
+        flush();
+        buf_.close();
+    }
+
+private:
+    bgzf_streambuf buf_;
+};
+
+
+} // namespace mc
+
+#endif
+
+#endif
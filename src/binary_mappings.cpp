@@ -0,0 +1,519 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <ostream>
+
+#include "binary_mappings.h"
+#include "database.h"
+#include "io_error.h"
+
+#ifdef RMA_BAM
+#include <zlib.h>
+#endif
+
+
+namespace mc {
+
+
+namespace {
+
+//-------------------------------------------------------------------
+constexpr char magic[8] = {'R','M','A','3','N','M','A','P'};
+constexpr std::uint32_t format_version = 1;
+
+constexpr std::uint8_t flag_headers = 1;
+
+constexpr std::uint8_t compression_none = 0;
+constexpr std::uint8_t compression_zlib = 1;
+
+// records, raw size, stored size, compression
+constexpr std::size_t block_header_size = 3 * 4 + 1;
+
+
+//-------------------------------------------------------------------
+inline void
+put_varint(std::vector<std::uint8_t>& out, std::uint64_t x)
+{
+    while (x >= 0x80) {
+        out.push_back(std::uint8_t(x | 0x80));
+        x >>= 7;
+    }
+    out.push_back(std::uint8_t(x));
+}
+
+
+//-------------------------------------------------------------------
+/// @throws file_read_error if value exceeds [p,end)
+inline std::uint64_t
+get_varint(const std::uint8_t*& p, const std::uint8_t* end)
+{
+    std::uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p >= end) break;
+        const auto b = *p++;
+        x |= std::uint64_t(b & 0x7f) << shift;
+        if (b < 0x80) return x;
+    }
+    throw file_read_error{"corrupt binary mapping block"};
+}
+
+
+//-------------------------------------------------------------------
+inline std::uint64_t zigzag(std::int64_t x) noexcept {
+    return (std::uint64_t(x) << 1) ^ std::uint64_t(x >> 63);
+}
+
+inline std::int64_t unzigzag(std::uint64_t x) noexcept {
+    return std::int64_t(x >> 1) ^ -std::int64_t(x & 1);
+}
+
+
+//-------------------------------------------------------------------
+/// @brief little endian fixed-size integers
+template<class UInt>
+inline void
+put_fixed(std::vector<std::uint8_t>& out, UInt x)
+{
+    for (std::size_t i = 0; i < sizeof(UInt); ++i) {
+        out.push_back(std::uint8_t(x >> (8 * i)));
+    }
+}
+
+template<class UInt>
+inline UInt
+get_fixed(const std::uint8_t* p) noexcept
+{
+    UInt x = 0;
+    for (std::size_t i = 0; i < sizeof(UInt); ++i) {
+        x |= UInt(p[i]) << (8 * i);
+    }
+    return x;
+}
+
+template<class UInt>
+inline UInt
+read_fixed(std::istream& is, const std::string& filename)
+{
+    std::uint8_t buf[sizeof(UInt)];
+    if (!is.read(reinterpret_cast<char*>(buf), sizeof(UInt))) {
+        throw file_read_error{"Unexpected end of binary mapping file", filename};
+    }
+    return get_fixed<UInt>(buf);
+}
+
+//-------------------------------------------------------------------
+inline std::uint64_t
+read_varint(std::istream& is, const std::string& filename)
+{
+    std::uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const auto c = is.get();
+        if (c == std::istream::traits_type::eof()) break;
+        x |= std::uint64_t(c & 0x7f) << shift;
+        if (c < 0x80) return x;
+    }
+    throw file_read_error{"Corrupt binary mapping file", filename};
+}
+
+} // namespace
+
+
+
+
+//-------------------------------------------------------------------
+void binary_mapping_block::add(const lazy_sequence_query& query,
+                               const classification_candidates& cands,
+                               const std::vector<mapping_alignment>& alignments,
+                               std::int64_t primary)
+{
+    put_varint(cols_[ids], zigzag(std::int64_t(query.id()) - std::int64_t(lastId_)));
+    lastId_ = query.id();
+
+    if (headers_) {
+        // first contiguous string only (as in mapping table)
+        const auto& header = query.header();
+        const auto l = std::min(header.find(' '), header.size());
+        put_varint(cols_[header_sizes], l);
+        cols_[headers].insert(cols_[headers].end(),
+                              header.begin(), header.begin() + l);
+    }
+
+    put_varint(cols_[cand_counts], cands.size());
+    put_varint(cols_[primaries], primary < 0 ? 0 : std::uint64_t(primary) + 1);
+
+    for (std::size_t i = 0; i < cands.size(); ++i) {
+        const auto& c = cands[i];
+        put_varint(cols_[targets], c.tgt);
+        put_varint(cols_[window_begins], c.pos.beg);
+        put_varint(cols_[window_sizes], c.pos.end - c.pos.beg);
+        put_varint(cols_[hits], c.hits);
+
+        const auto aln = i < alignments.size() ? alignments[i] : mapping_alignment{};
+        const bool aligned = aln.score >= 0 && aln.start >= 0;
+        put_varint(cols_[scores], aligned ? std::uint64_t(aln.score) + 1 : 0);
+        put_varint(cols_[starts], aligned ? std::uint64_t(aln.start) + 1 : 0);
+    }
+
+    ++records_;
+}
+
+
+
+//-------------------------------------------------------------------
+std::size_t binary_mapping_block::raw_size() const noexcept
+{
+    std::size_t n = 0;
+    for (const auto& col : cols_) n += col.size() + 10;
+    return n;
+}
+
+
+
+//-------------------------------------------------------------------
+void binary_mapping_block::seal(std::vector<std::uint8_t>& out)
+{
+    if (records_ < 1) return;
+
+    std::vector<std::uint8_t> raw;
+    raw.reserve(raw_size());
+    for (auto& col : cols_) {
+        put_varint(raw, col.size());
+        raw.insert(raw.end(), col.begin(), col.end());
+        col.clear();
+    }
+
+    constexpr auto maxSize = std::numeric_limits<std::uint32_t>::max();
+    if (raw.size() > maxSize || records_ > maxSize) {
+        throw file_write_error{"binary mapping block exceeds 4 GiB"};
+    }
+
+    const std::uint8_t* stored = raw.data();
+    std::size_t storedSize = raw.size();
+    std::uint8_t compression = compression_none;
+
+    #ifdef RMA_BAM
+    std::vector<std::uint8_t> packed(compressBound(uLong(raw.size())));
+    uLongf packedSize = uLongf(packed.size());
+    if (compress2(packed.data(), &packedSize, raw.data(), uLong(raw.size()),
+                  Z_BEST_SPEED) == Z_OK && packedSize < raw.size())
+    {
+        stored = packed.data();
+        storedSize = packedSize;
+        compression = compression_zlib;
+    }
+    #endif
+
+    put_fixed(out, std::uint32_t(records_));
+    put_fixed(out, std::uint32_t(raw.size()));
+    put_fixed(out, std::uint32_t(storedSize));
+    out.push_back(compression);
+    out.insert(out.end(), stored, stored + storedSize);
+
+    records_ = 0;
+    // ids are delta coded per block => blocks can be decoded independently
+    lastId_ = 0;
+}
+
+
+
+
+//-------------------------------------------------------------------
+binary_mapping_writer::binary_mapping_writer(const std::string& filename,
+                                             const database& db,
+                                             bool headers)
+:
+    filename_{filename},
+    os_{filename, std::ios::out | std::ios::binary},
+    headers_{headers}
+{
+    if (!os_.good()) {
+        throw file_write_error{"Could not write to file " + filename};
+    }
+
+    std::vector<std::uint8_t> buf {std::begin(magic), std::end(magic)};
+    put_fixed(buf, format_version);
+    buf.push_back(headers ? flag_headers : 0);
+
+    const auto& sk = db.target_sketcher();
+    put_fixed(buf, std::uint64_t(sk.window_stride()));
+    put_fixed(buf, std::uint64_t(sk.window_size()));
+
+    put_fixed(buf, std::uint64_t(db.target_count()));
+    for (std::size_t i = 0; i < db.target_count(); ++i) {
+        const auto& name = db.get_target(target_id(i)).name();
+        put_varint(buf, name.size());
+        buf.insert(buf.end(), name.begin(), name.end());
+    }
+
+    write(buf);
+}
+
+
+
+//-------------------------------------------------------------------
+binary_mapping_writer::~binary_mapping_writer()
+{
+    try { close(); } catch(...) {}
+}
+
+
+
+//-------------------------------------------------------------------
+binary_mapping_block binary_mapping_writer::make_block() const
+{
+    binary_mapping_block block;
+    block.headers_ = headers_;
+    return block;
+}
+
+
+
+//-------------------------------------------------------------------
+void binary_mapping_writer::write(const std::vector<std::uint8_t>& blocks)
+{
+    if (blocks.empty()) return;
+
+    os_.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+    if (!os_.good()) {
+        throw file_write_error{"Could not write to file " + filename_};
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void binary_mapping_writer::close()
+{
+    if (!os_.is_open()) return;
+
+    // end marker = empty block
+    write(std::vector<std::uint8_t>(block_header_size, 0));
+    os_.close();
+    if (os_.fail()) {
+        throw file_write_error{"Could not write to file " + filename_};
+    }
+}
+
+
+
+
+//-------------------------------------------------------------------
+binary_mapping_reader::binary_mapping_reader(const std::string& filename):
+    filename_{filename},
+    is_{filename, std::ios::in | std::ios::binary}
+{
+    if (!is_.good()) {
+        throw file_access_error{"Could not read file " + filename};
+    }
+
+    char m[sizeof(magic)];
+    if (!is_.read(m, sizeof(magic)) ||
+        !std::equal(std::begin(m), std::end(m), std::begin(magic)))
+    {
+        throw file_read_error{"Not a binary mapping file", filename};
+    }
+
+    const auto version = read_fixed<std::uint32_t>(is_, filename);
+    if (version != format_version) {
+        throw file_read_error{"Unsupported binary mapping format version "
+                              + std::to_string(version), filename};
+    }
+
+    const auto flags = read_fixed<std::uint8_t>(is_, filename);
+    headers_ = (flags & flag_headers) != 0;
+
+    windowStride_ = read_fixed<std::uint64_t>(is_, filename);
+    windowSize_ = read_fixed<std::uint64_t>(is_, filename);
+
+    const auto numTargets = read_fixed<std::uint64_t>(is_, filename);
+    targetNames_.reserve(std::min(numTargets, std::uint64_t(1) << 20));
+    for (std::uint64_t i = 0; i < numTargets; ++i) {
+        std::string name;
+        name.resize(read_varint(is_, filename));
+        if (!is_.read(&name[0], std::streamsize(name.size()))) {
+            throw file_read_error{"Unexpected end of binary mapping file", filename};
+        }
+        targetNames_.push_back(std::move(name));
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+const std::string& binary_mapping_reader::target_name(target_id tgt) const
+{
+    if (tgt >= targetNames_.size()) {
+        throw file_read_error{"Invalid target id in binary mapping file", filename_};
+    }
+    return targetNames_[tgt];
+}
+
+
+
+//-------------------------------------------------------------------
+bool binary_mapping_reader::read_block()
+{
+    std::uint8_t head[block_header_size];
+    if (!is_.read(reinterpret_cast<char*>(head), block_header_size)) {
+        throw file_read_error{"Unexpected end of binary mapping file "
+                              "(missing end marker)", filename_};
+    }
+    const auto records    = get_fixed<std::uint32_t>(head);
+    const auto rawSize    = get_fixed<std::uint32_t>(head + 4);
+    const auto storedSize = get_fixed<std::uint32_t>(head + 8);
+    const auto compression = head[12];
+
+    if (records == 0) {
+        done_ = true;
+        return false;
+    }
+
+    std::vector<std::uint8_t> stored(storedSize);
+    if (!is_.read(reinterpret_cast<char*>(stored.data()), storedSize)) {
+        throw file_read_error{"Unexpected end of binary mapping file", filename_};
+    }
+
+    if (compression == compression_none) {
+        if (storedSize != rawSize) {
+            throw file_read_error{"Corrupt block in binary mapping file", filename_};
+        }
+        raw_ = std::move(stored);
+    }
+    #ifdef RMA_BAM
+    else if (compression == compression_zlib) {
+        raw_.resize(rawSize);
+        uLongf size = rawSize;
+        if (uncompress(raw_.data(), &size, stored.data(), storedSize) != Z_OK ||
+            size != rawSize)
+        {
+            throw file_read_error{"Corrupt block in binary mapping file", filename_};
+        }
+    }
+    #endif
+    else {
+        throw file_read_error{"Unsupported block compression in binary mapping "
+                              "file (zlib requires a build with RMA_BAM)", filename_};
+    }
+
+    const std::uint8_t* p = raw_.data();
+    const std::uint8_t* end = p + raw_.size();
+    for (std::size_t c = 0; c < binary_mapping_block::num_columns; ++c) {
+        const auto n = get_varint(p, end);
+        if (n > std::uint64_t(end - p)) {
+            throw file_read_error{"Corrupt block in binary mapping file", filename_};
+        }
+        cols_[c] = p;
+        colEnds_[c] = p + n;
+        p += n;
+    }
+
+    remaining_ = records;
+    lastId_ = 0;
+    return true;
+}
+
+
+
+//-------------------------------------------------------------------
+bool binary_mapping_reader::next(mapping_record& rec)
+{
+    if (remaining_ == 0 && (done_ || !read_block())) return false;
+
+    using col = binary_mapping_block::column;
+
+    const auto get = [&] (col c) { return get_varint(cols_[c], colEnds_[c]); };
+
+    rec.id = query_id(std::int64_t(lastId_) + unzigzag(get(col::ids)));
+    lastId_ = rec.id;
+
+    rec.header.clear();
+    if (headers_) {
+        const auto n = get(col::header_sizes);
+        if (n > std::uint64_t(colEnds_[col::headers] - cols_[col::headers])) {
+            throw file_read_error{"Corrupt block in binary mapping file", filename_};
+        }
+        rec.header.assign(cols_[col::headers], cols_[col::headers] + n);
+        cols_[col::headers] += n;
+    }
+
+    const auto numCands = get(col::cand_counts);
+    rec.primary = std::int64_t(get(col::primaries)) - 1;
+
+    rec.candidates.resize(numCands);
+    for (auto& c : rec.candidates) {
+        c.tgt = target_id(get(col::targets));
+        c.windowBeg = get(col::window_begins);
+        c.windowEnd = c.windowBeg + get(col::window_sizes);
+        c.hits = std::uint32_t(get(col::hits));
+        const auto score = get(col::scores);
+        const auto start = get(col::starts);
+        c.alignment.score = std::int32_t(score) - 1;
+        c.alignment.start = std::int64_t(start) - 1;
+    }
+
+    --remaining_;
+    return true;
+}
+
+
+
+
+//-------------------------------------------------------------------
+void show_mapping_record(std::ostream& os,
+                         const binary_mapping_reader& reader,
+                         const classification_output_formatting& fmt,
+                         bool showLocations,
+                         const mapping_record& rec)
+{
+    const auto& colsep = fmt.tokens.column;
+
+    if (fmt.showQueryIds) os << rec.id << colsep;
+
+    if (reader.has_headers())
+        os << rec.header;
+    else
+        os << rec.id;
+    os << colsep;
+
+    for (std::size_t i = 0; i < rec.candidates.size(); ++i) {
+        if (i > 0) os << ',';
+        const auto& c = rec.candidates[i];
+        os << reader.target_name(c.tgt) << ':' << c.hits;
+    }
+    os << colsep;
+
+    if (showLocations) {
+        const auto w = reader.window_stride();
+        for (const auto& c : rec.candidates) {
+            os << '[' << (w * c.windowBeg)
+               << ',' << (w * c.windowEnd + reader.window_size()) << "] ";
+        }
+        os << colsep;
+    }
+
+    os << '\n';
+}
+
+
+} // namespace mc
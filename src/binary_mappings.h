@@ -0,0 +1,281 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+/*************************************************************************//**
+ *
+ * @file contains a compact binary, block-compressed, columnar format
+ *       for per-read mappings and a reader to access it
+ *
+ *       File layout (little endian):
+ *         magic "RMA3NMAP", uint32 version, uint8 flags,
+ *         uint64 window stride, uint64 window size,
+ *         uint64 number of targets, target names
+ *         blocks...
+ *         end marker (block with 0 records)
+ *
+ *       Block:
+ *         uint32 records, uint32 raw size, uint32 stored size,
+ *         uint8 compression (0: none, 1: zlib), stored bytes
+ *
+ *       Raw block = columns; each column: varint byte size + values:
+ *         query id (zigzag varint delta to previous record)
+ *         header size (varint), header characters
+ *         number of candidates (varint)
+ *         primary candidate (varint; 0: none, else index + 1)
+ *         target id, window begin, window range size, hits (varints)
+ *         alignment score (varint; 0: not aligned, else score + 1)
+ *         alignment start (varint; 0: not aligned, else position + 1)
+ *
+ *****************************************************************************/
+#ifndef RMA_BINARY_MAPPINGS_H_
+#define RMA_BINARY_MAPPINGS_H_
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "candidates.h"
+#include "config.h"
+#include "options.h"
+#include "querying.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief alignment summary of one mapping candidate
+ *
+ *****************************************************************************/
+struct mapping_alignment
+{
+    std::int32_t score = -1;     // edit distance of both mates; < 0: not aligned
+    std::int64_t start = -1;     // leftmost mate alignment start on target
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief mapping candidate as stored in binary mapping files
+ *
+ *****************************************************************************/
+struct mapping_candidate
+{
+    target_id tgt = 0;
+    std::uint64_t windowBeg = 0;
+    std::uint64_t windowEnd = 0;
+    std::uint32_t hits = 0;
+    mapping_alignment alignment;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief all mappings of one query (read or read pair)
+ *
+ *****************************************************************************/
+struct mapping_record
+{
+    query_id id = 0;
+    std::string header;
+    std::vector<mapping_candidate> candidates;
+    // index of primary (best aligned) candidate; < 0: none
+    std::int64_t primary = -1;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief collects records column-wise and encodes them into blocks
+ *
+ *****************************************************************************/
+class binary_mapping_block
+{
+public:
+    /// @brief raw size after which a block should be sealed
+    static constexpr std::size_t target_size() noexcept { return 1 << 20; }
+
+    //---------------------------------------------------------------
+    /**
+     * @param alignments  in candidate order; may be empty if not aligned
+     */
+    void add(const lazy_sequence_query&, const classification_candidates&,
+             const std::vector<mapping_alignment>& alignments,
+             std::int64_t primary);
+
+    //---------------------------------------------------------------
+    bool empty() const noexcept { return records_ == 0; }
+    std::size_t size() const noexcept { return records_; }
+
+    bool full() const noexcept { return raw_size() >= target_size(); }
+
+    //---------------------------------------------------------------
+    /**
+     * @brief encodes (and compresses) all records into 'out' and
+     *        starts a new block
+     */
+    void seal(std::vector<std::uint8_t>& out);
+
+
+private:
+    //---------------------------------------------------------------
+    enum column : std::size_t {
+        ids, header_sizes, headers, cand_counts, primaries,
+        targets, window_begins, window_sizes, hits,
+        scores, starts, num_columns
+    };
+
+    std::size_t raw_size() const noexcept;
+
+    std::array<std::vector<std::uint8_t>,num_columns> cols_;
+    std::size_t records_ = 0;
+    query_id lastId_ = 0;
+    bool headers_ = true;
+
+    friend class binary_mapping_writer;
+    friend class binary_mapping_reader;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief writes file header, sealed blocks and end marker
+ *
+ *****************************************************************************/
+class binary_mapping_writer
+{
+public:
+    //---------------------------------------------------------------
+    /**
+     * @param headers  store query headers (otherwise only query ids)
+     * @throws file_write_error
+     */
+    binary_mapping_writer(const std::string& filename, const database&,
+                          bool headers = true);
+
+    ~binary_mapping_writer();
+
+    binary_mapping_writer(const binary_mapping_writer&) = delete;
+    binary_mapping_writer& operator = (const binary_mapping_writer&) = delete;
+
+    //---------------------------------------------------------------
+    /// @brief block builder with the settings of this file
+    binary_mapping_block make_block() const;
+
+    /// @brief writes sealed blocks
+    void write(const std::vector<std::uint8_t>& blocks);
+
+    /// @brief writes end marker; no more blocks can be written afterwards
+    void close();
+
+    const std::string& filename() const noexcept { return filename_; }
+
+
+private:
+    std::string filename_;
+    std::ofstream os_;
+    bool headers_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief sequential reader for binary mapping files
+ *
+ *        Usage:
+ *            binary_mapping_reader reader {"mappings.bin"};
+ *            mapping_record rec;
+ *            while (reader.next(rec)) {
+ *                for (const auto& c : rec.candidates)
+ *                    ... reader.target_name(c.tgt) ...
+ *            }
+ *
+ *****************************************************************************/
+class binary_mapping_reader
+{
+public:
+    //---------------------------------------------------------------
+    /// @throws file_read_error
+    explicit
+    binary_mapping_reader(const std::string& filename);
+
+    //---------------------------------------------------------------
+    /**
+     * @brief reads next record
+     * @return false, if there are no more records
+     * @throws file_read_error on corrupt / truncated files
+     */
+    bool next(mapping_record&);
+
+    //---------------------------------------------------------------
+    bool has_headers() const noexcept { return headers_; }
+
+    std::size_t target_count() const noexcept { return targetNames_.size(); }
+    const std::string& target_name(target_id) const;
+
+    std::uint64_t window_stride() const noexcept { return windowStride_; }
+    std::uint64_t window_size() const noexcept { return windowSize_; }
+
+
+private:
+    bool read_block();
+
+    std::string filename_;
+    std::ifstream is_;
+    bool headers_ = true;
+    std::uint64_t windowStride_ = 0;
+    std::uint64_t windowSize_ = 0;
+    std::vector<std::string> targetNames_;
+
+    // current block
+    std::vector<std::uint8_t> raw_;
+    std::array<const std::uint8_t*,binary_mapping_block::num_columns> cols_;
+    std::array<const std::uint8_t*,binary_mapping_block::num_columns> colEnds_;
+    std::size_t remaining_ = 0;
+    query_id lastId_ = 0;
+    bool done_ = false;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief writes records as default mapping table (see 'show_query_mapping')
+ *
+ *****************************************************************************/
+void show_mapping_record(std::ostream&, const binary_mapping_reader&,
+                         const classification_output_formatting&,
+                         bool showLocations, const mapping_record&);
+
+
+} // namespace mc
+
+
+#endif
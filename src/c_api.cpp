@@ -0,0 +1,291 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "c_api.h"
+#include "read_mapper.h"
+
+
+/*************************************************************************//**
+ *
+ * @brief handle types
+ *
+ *****************************************************************************/
+struct rma_database
+{
+    explicit
+    rma_database(mc::database&& d): db{std::move(d)} {}
+
+    mc::database db;
+};
+
+
+struct rma_context
+{
+    rma_context(const mc::database& db, mc::query_options opt):
+        mapper{db, std::move(opt)}, ctx{mapper}
+    {}
+
+    mc::read_mapper mapper;
+    mc::read_mapper::context ctx;
+    std::vector<rma_candidate> candidates;
+    std::string cigars;
+};
+
+
+
+namespace {
+
+//-------------------------------------------------------------------
+thread_local std::string lastError;
+
+
+//-------------------------------------------------------------------
+void set_error(const char* msg) noexcept
+{
+    try { lastError = msg; } catch(...) {}
+}
+
+
+//-------------------------------------------------------------------
+/// @brief calls 'f' and turns exceptions into error messages
+template<class F, class R>
+R guarded(F&& f, R onError) noexcept
+{
+    try {
+        return f();
+    }
+    catch(std::exception& e) {
+        set_error(e.what());
+    }
+    catch(...) {
+        set_error("unknown error");
+    }
+    return onError;
+}
+
+
+//-------------------------------------------------------------------
+mc::query_options
+make_query_options(const rma_options* opt)
+{
+    rma_options o;
+    rma_options_init(&o);
+    if (opt) o = *opt;
+
+    mc::query_options qopt;
+    auto& cls = qopt.classify;
+    // hit threshold is deduced from the database if < 1
+    cls.hitsMin = o.hits_min > 0 ? std::uint16_t(o.hits_min) : 0;
+    cls.hitsCutoff = o.hits_cutoff;
+    // unlimited if < 1 (same as on the command line)
+    cls.maxNumCandidatesPerQuery = o.max_candidates > 0
+        ? std::size_t(o.max_candidates)
+        : std::numeric_limits<std::size_t>::max();
+    cls.insertSizeMax = std::size_t(std::max(std::int64_t(0), o.insert_size_max));
+    cls.adaptiveLookups = o.adaptive_lookups != 0;
+    cls.align = o.align != 0;
+    cls.maxEditDist = o.max_edit_distance;
+    cls.alignErrorRate = o.align_error_rate > 0 ? o.align_error_rate : 0;
+    qopt.performance.numThreads = 1;
+    return qopt;
+}
+
+
+//-------------------------------------------------------------------
+rma_mate_alignment
+make_mate_alignment(const mc::mate_alignment& a, std::string& cigars)
+{
+    if (cigars.size() + a.cigar.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::length_error{"CIGAR buffer exceeds 4 GiB; use smaller batches"};
+    }
+    rma_mate_alignment m;
+    m.aligned = a.aligned;
+    m.reverse = a.reverse;
+    m.score = a.score;
+    m.start = a.start;
+    m.end = a.end;
+    m.cigar_offset = std::uint32_t(cigars.size());
+    m.cigar_length = std::uint32_t(a.cigar.size());
+    cigars += a.cigar;
+    return m;
+}
+
+} // namespace
+
+
+
+extern "C" {
+
+//-------------------------------------------------------------------
+const char* rma_last_error(void)
+{
+    return lastError.c_str();
+}
+
+
+
+//-------------------------------------------------------------------
+void rma_options_init(rma_options* opt)
+{
+    if (!opt) return;
+    const mc::classification_options cls;
+    opt->hits_min = cls.hitsMin;
+    opt->hits_cutoff = cls.hitsCutoff;
+    opt->max_candidates = cls.maxNumCandidatesPerQuery <=
+        std::size_t(std::numeric_limits<int32_t>::max())
+        ? int32_t(cls.maxNumCandidatesPerQuery) : 0;
+    opt->insert_size_max = int64_t(cls.insertSizeMax);
+    opt->adaptive_lookups = cls.adaptiveLookups;
+    opt->align = cls.align;
+    opt->max_edit_distance = cls.maxEditDist;
+    opt->align_error_rate = cls.alignErrorRate;
+}
+
+
+
+//-------------------------------------------------------------------
+rma_database* rma_database_open(const char* filename, const rma_options* opt)
+{
+    return guarded([&] {
+        if (!filename) throw std::invalid_argument{"no database filename"};
+        return new rma_database{
+            mc::make_mapping_database(filename, make_query_options(opt))};
+    }, static_cast<rma_database*>(nullptr));
+}
+
+
+//-------------------------------------------------------------------
+void rma_database_close(rma_database* db)
+{
+    delete db;
+}
+
+
+//-------------------------------------------------------------------
+size_t rma_target_count(const rma_database* db)
+{
+    return db ? db->db.target_count() : 0;
+}
+
+
+//-------------------------------------------------------------------
+const char* rma_target_name(const rma_database* db, uint64_t target)
+{
+    if (!db || target >= db->db.target_count()) {
+        set_error("invalid target id");
+        return nullptr;
+    }
+    return db->db.get_target(mc::target_id(target)).name().c_str();
+}
+
+
+
+//-------------------------------------------------------------------
+rma_context* rma_context_create(const rma_database* db, const rma_options* opt)
+{
+    return guarded([&] {
+        if (!db) throw std::invalid_argument{"no database"};
+        return new rma_context{db->db, make_query_options(opt)};
+    }, static_cast<rma_context*>(nullptr));
+}
+
+
+//-------------------------------------------------------------------
+void rma_context_destroy(rma_context* ctx)
+{
+    delete ctx;
+}
+
+
+
+//-------------------------------------------------------------------
+int64_t rma_map_batch(rma_context* ctx, size_t count,
+                      const char* const* seqs1, const size_t* lens1,
+                      const char* const* seqs2, const size_t* lens2,
+                      rma_batch_result* result)
+{
+    return guarded([&] {
+        if (!ctx || !result) throw std::invalid_argument{"no context / result"};
+        if (count > 0 && (!seqs1 || !lens1)) {
+            throw std::invalid_argument{"no sequences"};
+        }
+        const bool paired = seqs2 && lens2;
+
+        auto& cands = ctx->candidates;
+        auto& cigars = ctx->cigars;
+        cands.clear();
+        cigars.clear();
+
+        for (size_t q = 0; q < count; ++q) {
+            const std::string_view s1 = seqs1[q] ? std::string_view{seqs1[q], lens1[q]}
+                                                 : std::string_view{};
+            const std::string_view s2 = paired && seqs2[q]
+                                      ? std::string_view{seqs2[q], lens2[q]}
+                                      : std::string_view{};
+
+            const auto& res = ctx->mapper.map(ctx->ctx, mc::query_id(q), {}, s1, s2);
+
+            for (size_t i = 0; i < res.candidates.size(); ++i) {
+                const auto& cand = res.candidates[i];
+                rma_candidate c;
+                c.query = q;
+                c.target = cand.tgt;
+                c.window_begin = cand.pos.beg;
+                c.window_end = cand.pos.end;
+                c.hits = cand.hits;
+                c.aligned = 0;
+                c.primary = 0;
+                c.score = -1;
+                c.mate1 = rma_mate_alignment{};
+                c.mate2 = rma_mate_alignment{};
+                // alignments are in candidate order
+                if (i < res.alignments.size()) {
+                    const auto& aln = res.alignments[i];
+                    c.aligned = 1;
+                    c.primary = aln.primary;
+                    c.score = aln.score;
+                    c.mate1 = make_mate_alignment(aln.mate1, cigars);
+                    c.mate2 = make_mate_alignment(aln.mate2, cigars);
+                }
+                cands.push_back(c);
+            }
+        }
+
+        result->candidates = cands.data();
+        result->num_candidates = cands.size();
+        result->cigars = cigars.data();
+        result->cigars_size = cigars.size();
+
+        return int64_t(cands.size());
+    }, int64_t(-1));
+}
+
+} // extern "C"
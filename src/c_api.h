@@ -0,0 +1,209 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+/*************************************************************************//**
+ *
+ * @file contains the C interface of the embeddable library
+ *       'librmapalign3n' for use from other languages (FFI)
+ *
+ *       Typical use:
+ *         rma_database* db = rma_database_open("refs.db", &opt);
+ *         per thread:
+ *           rma_context* ctx = rma_context_create(db, &opt);
+ *           rma_map_batch(ctx, n, seqs1, lens1, seqs2, lens2, &result);
+ *           ... read result (valid until next call with ctx) ...
+ *           rma_context_destroy(ctx);
+ *         rma_database_close(db);
+ *
+ *       Functions that can fail return NULL or a negative value;
+ *       rma_last_error() then describes the error of the calling thread.
+ *
+ *****************************************************************************/
+#ifndef RMA_C_API_H_
+#define RMA_C_API_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*************************************************************************//**
+ *
+ * @brief opaque handles
+ *
+ *        rma_database  read-only database; can be shared by any number
+ *                      of contexts and threads
+ *        rma_context   mapping settings + reusable buffers;
+ *                      must only be used by one thread at a time
+ *
+ *****************************************************************************/
+typedef struct rma_database rma_database;
+typedef struct rma_context rma_context;
+
+
+
+/*************************************************************************//**
+ *
+ * @brief mapping settings; initialize with rma_options_init
+ *
+ *****************************************************************************/
+typedef struct rma_options
+{
+    int32_t hits_min;            /* < 1: deduce from database */
+    double hits_cutoff;
+    int32_t max_candidates;      /* per query; < 1: unlimited */
+    int64_t insert_size_max;     /* max. expected insert size of pairs */
+    int32_t adaptive_lookups;    /* != 0: stop lookups early */
+    int32_t align;               /* != 0: align candidates (needs targets) */
+    int32_t max_edit_distance;   /* < 0: automatic bound (align_error_rate) */
+    double align_error_rate;     /* initial bound = rate * read length; 0: unbounded */
+} rma_options;
+
+
+
+/*************************************************************************//**
+ *
+ * @brief alignment of one mate to a candidate target
+ *
+ *****************************************************************************/
+typedef struct rma_mate_alignment
+{
+    int32_t aligned;
+    int32_t reverse;             /* reverse complement of read aligned */
+    int32_t score;               /* edit distance */
+    int32_t start;               /* 0-based, on target */
+    int32_t end;                 /* 0-based, inclusive */
+    uint32_t cigar_offset;       /* CIGAR string in rma_batch_result::cigars */
+    uint32_t cigar_length;
+} rma_mate_alignment;
+
+
+
+/*************************************************************************//**
+ *
+ * @brief one mapping candidate of one query
+ *
+ *****************************************************************************/
+typedef struct rma_candidate
+{
+    uint64_t query;              /* index of query in batch */
+    uint64_t target;             /* target id */
+    uint64_t window_begin;       /* range of target windows with hits */
+    uint64_t window_end;
+    uint64_t hits;
+    int32_t aligned;             /* 0 if alignment is disabled */
+    int32_t primary;             /* best alignment of query */
+    int32_t score;               /* edit distance of both mates */
+    rma_mate_alignment mate1;
+    rma_mate_alignment mate2;
+} rma_candidate;
+
+
+
+/*************************************************************************//**
+ *
+ * @brief flat result arrays of one batch; memory is owned by the context
+ *        and stays valid until the next mapping call with that context
+ *
+ *****************************************************************************/
+typedef struct rma_batch_result
+{
+    const rma_candidate* candidates;   /* ordered by query */
+    size_t num_candidates;
+    const char* cigars;                /* concatenated, not 0-terminated */
+    size_t cigars_size;
+} rma_batch_result;
+
+
+
+/*************************************************************************//**
+ *
+ * @brief error message of last failed call in the calling thread
+ *
+ *****************************************************************************/
+const char* rma_last_error(void);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief default settings (same as command line defaults)
+ *
+ *****************************************************************************/
+void rma_options_init(rma_options*);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief database handling;
+ *        target sequences are only loaded if 'opt->align' is set
+ *        (opt may be NULL)
+ *
+ *****************************************************************************/
+rma_database* rma_database_open(const char* filename, const rma_options* opt);
+
+void rma_database_close(rma_database*);
+
+size_t rma_target_count(const rma_database*);
+
+/* 0-terminated; valid as long as the database is open */
+const char* rma_target_name(const rma_database*, uint64_t target);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief per-thread mapping context (opt may be NULL)
+ *
+ *****************************************************************************/
+rma_context* rma_context_create(const rma_database*, const rma_options* opt);
+
+void rma_context_destroy(rma_context*);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief maps a batch of reads or read pairs
+ *
+ *        Sequences are read directly from the caller's memory.
+ *        seqs2/lens2 may be NULL for single-end reads;
+ *        individual mates 2 may be NULL / have length 0.
+ *
+ * @return number of candidates or -1 on error
+ *
+ *****************************************************************************/
+int64_t rma_map_batch(rma_context*, size_t count,
+                      const char* const* seqs1, const size_t* lens1,
+                      const char* const* seqs2, const size_t* lens2,
+                      rma_batch_result* result);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
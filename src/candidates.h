@@ -24,8 +24,10 @@
 #define RMA_CANDIDATES_H_
 
 
+#include <algorithm>
 #include <cstdint>
 #include <limits>
+#include <vector>
 
 #include "database.h"
 
@@ -99,6 +101,13 @@ struct candidate_generation_rules
 
     //maximum number of candidates to be generated
     std::size_t maxCandidates = std::numeric_limits<std::size_t>::max();
+
+    //candidates with fewer hits can be discarded early
+    match_candidate::count_type hitsMin = 0;
+
+    //candidates with fewer hits relative to the top candidate
+    //can be discarded early
+    double hitsCutoff = 0.0;
 };
 
 
@@ -332,6 +341,128 @@ private:
 };
 
 
+/*************************************************************************//**
+*
+* @brief processes a database match list and
+*        stores contiguous window ranges of *distinct* targets;
+*        keeps at most 'maxCandidates' candidates with the most hits in a
+*        fixed-size heap and discards candidates as soon as they can no
+*        longer pass the 'hitsMin' and 'hitsCutoff' thresholds
+*
+*        The resulting candidates are ordered by target id like the ones
+*        produced by 'distinct_matches_in_contiguous_window_ranges'.
+*        Ties are resolved in favor of the target with the smaller id.
+*
+*****************************************************************************/
+class top_distinct_matches_in_contiguous_window_ranges
+{
+    using candidates_list = std::vector<match_candidate>;
+    using count_type      = match_candidate::count_type;
+
+public:
+    using size_type      = std::size_t;
+    using iterator       = candidates_list::iterator;
+    using const_iterator = candidates_list::const_iterator;
+
+
+    /****************************************************************
+     */
+    top_distinct_matches_in_contiguous_window_ranges() = default;
+
+
+    /****************************************************************
+     * @pre matches must be sorted by target (first) and window (second)
+     */
+    template<class Locations>
+    top_distinct_matches_in_contiguous_window_ranges(
+        const Locations& matches,
+        const candidate_generation_rules& rules = candidate_generation_rules{})
+    :
+        top_{}, maxHits_{0}
+    {
+        if (rules.maxCandidates < 1) return;
+
+        top_.reserve(std::min(rules.maxCandidates, size_type(16)));
+
+        for_all_contiguous_window_ranges(matches, rules.maxWindowsInRange,
+            [&,this] (match_candidate& cand) {
+                return insert(cand, rules);
+            });
+
+        std::sort(top_.begin(), top_.end(),
+            [] (const match_candidate& a, const match_candidate& b) {
+                return a.tgt < b.tgt;
+            });
+    }
+
+
+    //---------------------------------------------------------------
+    auto begin() const noexcept { return top_.begin(); }
+    auto end()   const noexcept { return top_.end(); }
+    auto begin() noexcept { return top_.begin(); }
+    auto end()   noexcept { return top_.end(); }
+
+    bool empty() const noexcept { return top_.empty(); }
+    size_type size()  const noexcept { return top_.size(); }
+
+    const match_candidate&
+    operator [] (size_type i) const noexcept { return top_[i]; }
+
+    auto erase(const_iterator pos) { return top_.erase(pos); }
+    auto erase(const_iterator first, const_iterator last) { return top_.erase(first, last); }
+
+
+private:
+    /****************************************************************
+     * @brief heap order: the worst candidate is at the front
+     */
+    static bool
+    better(const match_candidate& a, const match_candidate& b) noexcept {
+        return a.hits > b.hits || (a.hits == b.hits && a.tgt < b.tgt);
+    }
+
+    bool below_cutoff(count_type hits, const candidate_generation_rules& rules) const noexcept {
+        return double(hits) / maxHits_ < rules.hitsCutoff;
+    }
+
+    /****************************************************************
+     * @brief insert candidate, evict candidates that can no longer qualify
+     */
+    bool insert(const match_candidate& cand,
+                const candidate_generation_rules& rules)
+    {
+        if (cand.hits < rules.hitsMin) return true;
+
+        if (cand.hits > maxHits_) {
+            maxHits_ = cand.hits;
+            // new top candidate might disqualify previous ones
+            while (!top_.empty() && below_cutoff(top_.front().hits, rules)) {
+                std::pop_heap(top_.begin(), top_.end(), better);
+                top_.pop_back();
+            }
+        }
+        else if (below_cutoff(cand.hits, rules)) {
+            return true;
+        }
+
+        if (top_.size() < rules.maxCandidates) {
+            top_.push_back(cand);
+            std::push_heap(top_.begin(), top_.end(), better);
+        }
+        else if (better(cand, top_.front())) {
+            std::pop_heap(top_.begin(), top_.end(), better);
+            top_.back() = cand;
+            std::push_heap(top_.begin(), top_.end(), better);
+        }
+        return true;
+    }
+
+
+    candidates_list top_;
+    count_type maxHits_ = 0;
+};
+
+
 } // namespace mc
 
 
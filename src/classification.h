@@ -39,9 +39,19 @@ namespace mc {
 
 /// @brief forward declarations
 struct query_options;
+struct classification_options;
 struct classification_results;
 
 
+/*************************************************************************//**
+ *
+ * @brief sets up some query options according to database parameters
+ *        or command line options
+ *
+ *****************************************************************************/
+void adapt_options_to_database(classification_options&, const database&);
+
+
 /*************************************************************************//**
  *
  * @brief try to map each read from the input files to a target
@@ -53,6 +63,21 @@ void map_queries_to_targets(
     const database&, const query_options&,
     classification_results&);
 
+
+/*************************************************************************//**
+ *
+ * @brief try to map each read from the input files to targets in
+ *        each of the databases; every read is parsed only once;
+ *        one result object per database
+ *
+ *****************************************************************************/
+void map_queries_to_targets(
+    const std::vector<std::string>& inputFilenames,
+    const std::vector<const database*>&,
+    const std::vector<std::string>& databaseNames,
+    const query_options&,
+    const std::vector<classification_results*>&);
+
 } // namespace mc
 
 #endif
@@ -104,6 +104,30 @@ public:
         ++correctlyRejected_;
     }
 
+    // plain copy of all counters (e.g. for checkpoints)
+    struct counters {
+        count_t totalReads = 0;
+        count_t totalMatches = 0;
+        count_t alignedReads = 0;
+        count_t originMapped = 0;
+        double originMappedWeighted = 0;
+        count_t correctlyRejected = 0;
+    };
+
+    counters snapshot() const noexcept {
+        return counters{totalReads_, totalMatches_, alignedReads_,
+                        originMapped_, originMappedWeighted_, correctlyRejected_};
+    }
+
+    void restore(const counters& c) noexcept {
+        totalReads_ = c.totalReads;
+        totalMatches_ = c.totalMatches;
+        alignedReads_ = c.alignedReads;
+        originMapped_ = c.originMapped;
+        originMappedWeighted_ = c.originMappedWeighted;
+        correctlyRejected_ = c.correctlyRejected;
+    }
+
 private:
     using atom_t = std::atomic<count_t>;
     atom_t totalReads_{0};   // total #reads
@@ -118,6 +142,67 @@ private:
 };
 
 
+/*************************************************************************//**
+ *
+ * @brief for tracking the number of database feature lookups
+ *
+ *****************************************************************************/
+class lookup_statistics
+{
+public:
+    using count_t = std::uint_least64_t;
+
+    void add(count_t performed, count_t skipped) noexcept {
+        performed_ += performed;
+        skipped_ += skipped;
+    }
+
+    count_t performed() const noexcept { return performed_; }
+    count_t skipped()   const noexcept { return skipped_; }
+
+    count_t total() const noexcept { return performed_ + skipped_; }
+
+    // plain copy of all counters (e.g. for checkpoints)
+    struct counters {
+        count_t performed = 0;
+        count_t skipped = 0;
+    };
+
+    counters snapshot() const noexcept { return counters{performed_, skipped_}; }
+
+    void restore(const counters& c) noexcept {
+        performed_ = c.performed;
+        skipped_ = c.skipped;
+    }
+
+private:
+    std::atomic<count_t> performed_{0};
+    std::atomic<count_t> skipped_{0};
+};
+
+
+/*************************************************************************//**
+ *
+ * @brief batch settings used during querying (set by auto tuning)
+ *
+ *****************************************************************************/
+class batch_statistics
+{
+public:
+    void record(std::size_t batchSize, std::size_t batchesInFlight) noexcept {
+        batchSize_ = batchSize;
+        inFlight_ = batchesInFlight;
+    }
+
+    std::size_t batch_size() const noexcept { return batchSize_; }
+    std::size_t batches_in_flight() const noexcept { return inFlight_; }
+
+private:
+    std::size_t batchSize_ = 0;
+    std::size_t inFlight_ = 0;
+};
+
+
 } // namespace mc
 
 
@@ -22,10 +22,13 @@
 #include <sstream>
 #include <stdexcept>
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 
 #include "querying.h"
 #include "candidates.h"
 #include "matches_per_target.h"
+#include "query_checkpoint.h"
 #include "printing.h"
 #include "querying.h"
 #include "options.h"
@@ -33,7 +36,7 @@
 #include "classification.h"
 #include "classify_common.h"
 
-#include "../dep/edlib.h"
+#include "alignment.h"
 
 #ifdef RMA_BAM
 #include <sam.h>
@@ -49,6 +52,28 @@ using std::string;
 using bam_vector = std::vector<bam1_t>;
 #endif
 
+/*************************************************************************//**
+ *
+ * @brief print column names of mapping results
+ *
+ *****************************************************************************/
+void show_query_mapping_columns_header(std::ostream& os,
+                                       const classification_output_options& opt,
+                                       const string& prefix = "")
+{
+    const auto& colsep = opt.format.tokens.column;
+
+    if (opt.evaluate.showGroundTruth) {
+        show_target_header(os, opt.format, prefix + "truth_");
+        os << colsep;
+    }
+
+    if (opt.analysis.showAllHits) os << prefix << "all_hits" << colsep;
+    os << prefix << "top_hits" << colsep;
+    if (opt.analysis.showLocations) os << prefix << "candidate_locations" << colsep;
+}
+
+
 /*************************************************************************//**
  *
  * @brief print header line for mapping table
@@ -67,14 +92,34 @@ void show_query_mapping_header(std::ostream& os,
 
     os << "query_header" << colsep;
 
-    if (opt.evaluate.showGroundTruth) {
-        show_target_header(os, opt.format, "truth_");
-        os << colsep;
-    }
+    show_query_mapping_columns_header(os, opt);
+
+    os << '\n';
+}
+
+
+/*************************************************************************//**
+ *
+ * @brief print header line for combined mapping table
+ *
+ *****************************************************************************/
+void show_query_mapping_header(std::ostream& os,
+                               const classification_output_options& opt,
+                               const vector<string>& dbNames)
+{
+    if (!opt.format.showMapping) return;
+
+    const auto& colsep = opt.format.tokens.column;
 
-    if (opt.analysis.showAllHits) os << "all_hits" << colsep;
-    os << "top_hits" << colsep;
-    if (opt.analysis.showLocations) os << "candidate_locations" << colsep;
+    os << opt.format.tokens.comment << "TABLE_LAYOUT: ";
+
+    if (opt.format.showQueryIds) os << "query_id" << colsep;
+
+    os << "query_header" << colsep;
+
+    for (const auto& name : dbNames) {
+        show_query_mapping_columns_header(os, opt, name + ":");
+    }
 
     os << '\n';
 }
@@ -168,7 +213,7 @@ void for_each_eligible_mapping(const classification_options& opt,
 template<class Action>
 void for_each_eligible_mapping(const database& db,
                       const classification_options& opt,
-                      const sequence_query& query,
+                      const lazy_sequence_query& query,
                       const match_locations& allhits,
                       Action&& action)
 {
@@ -201,15 +246,57 @@ void hits_cutoff_filter(const classification_options& opt,
 }
 
 
+/*************************************************************************//**
+ *
+ * @brief sets up some query options according to database parameters
+ *        or command line options
+ *
+ *****************************************************************************/
+void adapt_options_to_database(classification_options& opt, const database& db)
+{
+    //deduce hit threshold from database?
+    if (opt.hitsMin < 1) {
+        auto sks = db.target_sketcher().sketch_size();
+        if (sks >= 6) {
+            opt.hitsMin = static_cast<int>(sks / 3.0);
+        } else if (sks >= 4) {
+            opt.hitsMin = 2;
+        } else {
+            opt.hitsMin = 1;
+        }
+    }
+}
+
+
+/*************************************************************************//**
+ *
+ * @brief fraction of queries used for coverage estimation (1st pass)
+ *
+ *****************************************************************************/
+double coverage_sample_fraction(const vector<string>& infiles,
+                                const query_options& opt)
+{
+    double fraction = std::min(1.0, opt.classify.covSampleFraction);
+
+    if (opt.classify.covSampleBudget > 0) {
+        const auto numQueries = estimate_query_count(infiles, opt);
+        if (numQueries > 0) {
+            fraction = std::min(fraction,
+                double(opt.classify.covSampleBudget) / numQueries);
+        }
+    }
+    return fraction;
+}
+
+
 /*************************************************************************//**
  *
  * @brief applies coverage filter to a list of taxa
  *
  *****************************************************************************/
-void coverage_filter(const database& db,
-                     const classification_options& opt,
+void coverage_filter(const classification_options& opt,
                      classification_candidates& cands,
-                     const matches_per_target_light& mpt)
+                     const coverage_per_target& coverage)
 {
     double norm = 0.0;
 
@@ -219,9 +306,7 @@ void coverage_filter(const database& db,
             break;
         case coverage_norm::max:
             for (const auto& cand: cands) {
-                double cov = double(mpt.num_hits(cand.tgt))
-                             / db.get_target(cand.tgt).source().windows;
-                norm = std::max(norm, cov);
+                norm = std::max(norm, coverage[cand.tgt]);
             }
             if (std::abs(norm) <= std::numeric_limits<double>::min()) return;
             norm = 1.0 / norm;
@@ -231,16 +316,12 @@ void coverage_filter(const database& db,
     cands.erase(
         std::remove_if (cands.begin(), cands.end(),
         [&](match_candidate& cand) {
-            double cov = double(mpt.num_hits(cand.tgt))
-                         / db.get_target(cand.tgt).source().windows;
-            return cov * norm < opt.covMin;
+            return coverage[cand.tgt] * norm < opt.covMin;
         }), cands.end());
 }
 
 
 
-
-
 /*************************************************************************//**
  *
  * @brief
@@ -250,15 +331,15 @@ template<class Locations>
 classification
 classify(const database& db,
          const classification_options& opt,
-         const sequence_query& query,
+         const lazy_sequence_query& query,
          const Locations& allhits,
-         const matches_per_target_light& cov)
+         const coverage_per_target& cov)
 {
     classification cls { make_classification_candidates(db, opt, query, allhits) };
 
     hits_cutoff_filter(opt, cls.candidates);
 
-    coverage_filter(db, opt, cls.candidates, cov);
+    coverage_filter(opt, cls.candidates, cov);
 
     return cls;
 }
@@ -302,8 +383,14 @@ struct bam_buffer
         size_t n_cigar, const uint32_t *cigar,
         int32_t mtid, hts_pos_t mpos, hts_pos_t isize,
         size_t l_seq, const char *seq, const char *qual,
-        size_t l_aux)
+        size_t l_aux,
+        const conversion_caller::mate_calls* calls = nullptr)
     {
+        // tag + type + 0-terminated string
+        const auto tagSize = [] (const std::string& str) { return 3 + str.size() + 1; };
+        if (calls && !calls->empty())
+            l_aux += tagSize(calls->xm) + tagSize(calls->xr) + tagSize(calls->xg);
+
         vec.emplace_back();
         bam1_t& b = vec.back();
         bam_set_mempolicy(&b, BAM_USER_OWNS_STRUCT);
@@ -318,6 +405,16 @@ struct bam_buffer
         if (ret < 0) {
             std::cerr << "!!! bam_set1 ERROR: " << ret << " !!!!" << std::endl;
         }
+        else if (calls && !calls->empty()) {
+            // space is reserved => no reallocation
+            const auto appendTag = [&] (const char* tag, const std::string& str) {
+                bam_aux_append(&b, tag, 'Z', int(str.size() + 1),
+                               reinterpret_cast<const uint8_t*>(str.c_str()));
+            };
+            appendTag("XM", calls->xm);
+            appendTag("XR", calls->xr);
+            appendTag("XG", calls->xg);
+        }
 
         if ((bam_get_mempolicy(&b) & BAM_USER_OWNS_DATA) != 0) {
             b.m_data = std::min(b.m_data, (uint32_t(b.l_data) + 7) & (~7U));
@@ -350,6 +447,15 @@ struct mappings_buffer
 
     matches_per_target_light coverage;
 
+    conversion_counts conversions;
+
+    // binary mapping output: alignment summary of current query
+    // and encoded blocks of current batch
+    std::vector<mapping_alignment> alignments;
+    std::int64_t primary = -1;
+    binary_mapping_block binary;
+    std::vector<std::uint8_t> binaryBlocks;
+
     #ifdef RMA_BAM
     bam_buffer bam_buf;
     mappings_buffer() = default;
@@ -360,95 +466,19 @@ struct mappings_buffer
 
 /*************************************************************************//**
  *
- * @brief edlib alignment container
+ * @brief per-batch output buffers for querying multiple databases
  *
  *****************************************************************************/
-struct edlib_alignment {
-
-    enum struct status {FORWARD, REVERSE, UNALIGNED};
-
-    edlib_alignment(const std::string& query, target_id tgt, const database& db, int max_edit_distance):
-        tgt_(tgt), status_(status::UNALIGNED), score_(query.size()), cigar_(nullptr)
-    {
-        const std::string& target = db.get_target(tgt).seq();
-
-        auto edlib_config = edlibNewAlignConfig(max_edit_distance, EDLIB_MODE_HW, EDLIB_TASK_PATH, additionalEqualities.data(), additionalEqualities.size());
-        
-        auto regular = edlibAlign(query.c_str(), query.size(), target.c_str(), target.size(), edlib_config);
-        std::string reverse_query = make_reverse_complement(query);
-        auto reverse_complement = edlibAlign(reverse_query.c_str(), reverse_query.size(), target.c_str(), target.size(), edlib_config);
-        
-        if (regular.status != EDLIB_STATUS_OK || regular.status != EDLIB_STATUS_OK) {
-            throw std::runtime_error{"edlib failed!"};
-        }
-
-        // keep in mind ../dep/edlip.cpp:212
-        // start loc is always on reference, but end can be negative
-        if (regular.editDistance >= 0 && regular.endLocations[0] >= 0 &&
-           (reverse_complement.editDistance < 0 || reverse_complement.endLocations[0] < 0 ||
-            reverse_complement.editDistance >= regular.editDistance))
-        {
-            status_ = status::FORWARD;
-            start_ = regular.startLocations[0];
-            end_ = regular.endLocations[0];
-            score_ = regular.editDistance;
-            cigar_ = edlibAlignmentToCigar(regular.alignment, regular.alignmentLength, EDLIB_CIGAR_STANDARD);
-        } 
-        else if (reverse_complement.editDistance >= 0 && reverse_complement.endLocations[0] >= 0)
-        {
-            status_ = status::REVERSE;
-            start_ = reverse_complement.startLocations[0];
-            end_ = reverse_complement.endLocations[0];
-            score_ = reverse_complement.editDistance;
-            cigar_ = edlibAlignmentToCigar(reverse_complement.alignment, reverse_complement.alignmentLength, EDLIB_CIGAR_STANDARD);
-        }
-        edlibFreeAlignResult(regular);
-        edlibFreeAlignResult(reverse_complement);
-    }
-
-    edlib_alignment(const edlib_alignment&) = delete;
-    edlib_alignment& operator=(const edlib_alignment&) = delete;
-    edlib_alignment& operator=(edlib_alignment&&) = delete;
-    
-    edlib_alignment(edlib_alignment&& other):
-        tgt_(other.tgt_), status_(other.status_), score_(other.score_), start_(other.start_), end_(other.end_), cigar_(other.cigar_)
-    {
-        other.cigar_ = nullptr;
-    }
-
-    ~edlib_alignment() {free(cigar_);}
-
-    bool aligned() const noexcept {return status_!=status::UNALIGNED;}
-    int score() const noexcept {return score_;}
-    status orientation() const noexcept {return status_;}
-    target_id tgt() const noexcept {return tgt_;}
-    int start() const noexcept {return start_;}
-    int end() const noexcept {return end_;}
-    const char * cigar() const noexcept {return cigar_;}
+struct multi_mappings_buffer
+{
+    // one buffer per database
+    std::vector<mappings_buffer> dbs;
 
-private:
-    static std::vector<EdlibEqualityPair> additionalEqualities;
-    target_id tgt_;
-    status status_;
-    int score_;
-    int start_, end_;
-    char * cigar_;
+    // combined mapping line of current query
+    std::ostringstream line;
+    bool mapped = false;
 };
 
-std::vector<EdlibEqualityPair> edlib_alignment::additionalEqualities({{'a', 'A'}, {'t', 'T'}, {'c', 'C'}, {'g', 'G'}});
-
-struct edlib_alignment_pair {
-    edlib_alignment_pair(const sequence_query& query, target_id tgt, const database& db, int max_edit_distance):
-        first(query.seq1, tgt, db, max_edit_distance),
-        second(query.seq2, tgt, db, max_edit_distance)
-    {}
-
-    bool aligned() const noexcept {return first.aligned() || second.aligned();}
-    int score() const noexcept {return first.score() + second.score();}
-    target_id tgt() const noexcept {return first.tgt();};
-
-    edlib_alignment first, second;
-};
 
 using alns_vector = std::vector<edlib_alignment_pair>;
 
@@ -570,11 +600,25 @@ void show_sam_minimal(std::ostream& os, const target& tgt, const sequence_query&
 
 
 
+void show_conversion_tags(std::ostream& os,
+                          const conversion_caller::mate_calls* calls)
+{
+    if (!calls || calls->empty()) return;
+
+    os << "XM:Z:" << calls->xm << '\t'
+       << "XR:Z:" << calls->xr << '\t'
+       << "XG:Z:" << calls->xg;
+}
+
+
+
 void show_sam_alignment(std::ostream& os,
                         const database& db,
                         const sequence_query& query,
                         const edlib_alignment_pair& alignment,
-                        bool primary)
+                        bool primary,
+                        const conversion_caller::mate_calls* calls1 = nullptr,
+                        const conversion_caller::mate_calls* calls2 = nullptr)
 {
     const target& tgt = db.get_target(alignment.tgt());
 
@@ -654,6 +698,8 @@ void show_sam_alignment(std::ostream& os,
     // QUAL
     os << "*" << '\t';
 
+    show_conversion_tags(os, calls1);
+
     os << '\n';
 
     //----------------------------------- 
@@ -695,11 +741,16 @@ void show_sam_alignment(std::ostream& os,
     // QUAL
     os << "*" << '\t';
 
+    show_conversion_tags(os, calls2);
+
     os << '\n';
 }
 
 #ifdef RMA_BAM
-void show_bam_alignment(bam_buffer& bam_buf, const sequence_query& query, const edlib_alignment_pair& alignment, bool primary) {
+void show_bam_alignment(bam_buffer& bam_buf, const sequence_query& query, const edlib_alignment_pair& alignment, bool primary,
+                        const conversion_caller::mate_calls* calls1 = nullptr,
+                        const conversion_caller::mate_calls* calls2 = nullptr)
+{
 
     // function only applicable for mapped reads atm
     // function only applicable for paired reads atm
@@ -763,7 +814,7 @@ void show_bam_alignment(bam_buffer& bam_buf, const sequence_query& query, const
 
     // mate 1
     bam_buf.add_bam(query.header.size()-2, query.header.data(), flag1, tgt_id, pos1, 255, n_cigar, cigar,
-                    tgt_id, pos2, tlen1, query.seq1.size(), seq, nullptr, 0);
+                    tgt_id, pos2, tlen1, query.seq1.size(), seq, nullptr, 0, calls1);
 
     if (alignment.second.aligned())
         n_cigar = sam_parse_cigar(alignment.second.cigar(), nullptr, &cigar, &a_cigar);
@@ -776,7 +827,7 @@ void show_bam_alignment(bam_buffer& bam_buf, const sequence_query& query, const
     
     // mate 2
     bam_buf.add_bam(query.header.size()-2, query.header.data(), flag2, tgt_id, pos2, 255, n_cigar, cigar,
-                    tgt_id, pos1, tlen2, query.seq2.size(), seq, nullptr, 0);
+                    tgt_id, pos1, tlen2, query.seq2.size(), seq, nullptr, 0, calls2);
 
     free(cigar);
 }
@@ -817,22 +868,42 @@ void show_bam_minimal(bam_buffer& bam_buf, const database& db, const sequence_qu
 
 #ifdef RMA_BAM
 void prepare_bam(const database& db, const query_options& opt, classification_results& results) {
-    std::string sam_header_text = db.get_sam_header();
-    results.bamOut = sam_open(opt.samFile.data(), "wb1");
+    // CRAM reference names must match FASTA index names
+    const bool cram = opt.output.samMode == sam_mode::cram;
+    std::string sam_header_text = db.get_sam_header(cram);
+    if (cram) {
+        // reference must be known before header is written
+        results.cramRef = std::make_unique<cram_reference>(db);
+        results.bamOut = sam_open(results.bamFilename.data(), "wc");
+        if (results.bamOut) {
+            hts_set_fai_filename(results.bamOut, results.cramRef->filename().data());
+        }
+    }
+    else {
+        results.bamOut = sam_open(results.bamFilename.data(), "wb1");
+    }
+    if (!results.bamOut) {
+        throw file_write_error{"Could not write to file " + results.bamFilename};
+    }
+    // records are encoded by htslib's thread pool; sam_write1 only queues them
     hts_set_threads(results.bamOut, opt.performance.bamThreads);
     results.bamHdr = sam_hdr_parse(sam_header_text.size(), sam_header_text.data());
-    sam_hdr_write(results.bamOut, results.bamHdr);
+    if (!results.bamHdr || sam_hdr_write(results.bamOut, results.bamHdr) < 0) {
+        throw file_write_error{"Could not write header to file " + results.bamFilename};
+    }
 }
 #endif
 
 
 void show_as_alignment(mappings_buffer& buf, const database& db, 
-    const query_options& opt, const sequence_query& query, 
+    const query_options& opt, const lazy_sequence_query& lazyQuery, 
     const classification_candidates& cands)
 {
     if (opt.output.samMode == sam_mode::none || cands.empty())
         return;
 
+    const auto& query = lazyQuery.unpacked();
+
     size_t primary = 0;
     for (size_t i = 0; i < cands.size(); ++i)
         if (cands[primary].hits < cands[i].hits)
@@ -843,7 +914,7 @@ void show_as_alignment(mappings_buffer& buf, const database& db,
             show_sam_minimal(buf.align_out, db.get_target(cands[i].tgt), query, i == primary);
     
     #ifdef RMA_BAM
-    else if (opt.output.samMode == sam_mode::bam)
+    else if (htslib_output(opt.output.samMode))
         for (size_t i = 0; i < cands.size(); ++i)
             show_bam_minimal(buf.bam_buf, db, query, cands[i].tgt, i == primary);
     #endif
@@ -851,138 +922,447 @@ void show_as_alignment(mappings_buffer& buf, const database& db,
 
 
 void align_candidates(mappings_buffer& buf, const database& db, 
-    const query_options& opt, const sequence_query& query, 
+    const query_options& opt, const lazy_sequence_query& lazyQuery, 
     classification_candidates& cands)
 {
     if (cands.empty()) return; 
+
+    const auto& query = lazyQuery.unpacked();
     
     alns_vector alns;
-    size_t primary = 0;
-
-    const auto align_candidate = [&](const auto& cand) {
-        alns.emplace_back(query, cand.tgt, db, opt.classify.maxEditDist);
-        if (!alns.back().aligned()) {
-            alns.pop_back();
-            return true;
-        } else if (alns.back().score() < alns[primary].score()) {
-            primary = alns.size()-1;
+    const auto primary = make_candidate_alignments(
+                             db, opt.classify, query, cands, alns);
+
+    if (!opt.binaryMappingsFile.empty()) {
+        for (const auto& aln : alns) {
+            mapping_alignment a;
+            a.score = aln.score();
+            if (aln.first.aligned() && aln.second.aligned())
+                a.start = std::min(aln.first.start(), aln.second.start());
+            else
+                a.start = aln.first.aligned() ? aln.first.start() : aln.second.start();
+            buf.alignments.push_back(a);
         }
-        return false;
-    };
+        if (!alns.empty()) buf.primary = std::int64_t(primary);
+    }
 
-    cands.erase(std::remove_if (cands.begin(), cands.end(), align_candidate), cands.end());
+    const bool showCalls = opt.output.showConversionCalls &&
+                           opt.output.samMode != sam_mode::none;
+    const bool countCalls = !opt.conversionTableFile.empty();
 
-    if (opt.output.samMode == sam_mode::sam)
-        for (size_t i = 0; i < alns.size(); ++i)
-            show_sam_alignment(buf.align_out, db, query, alns[i], i == primary);
-    
-    #ifdef RMA_BAM
-    else if (opt.output.samMode == sam_mode::bam)
-        for (size_t i = 0; i < alns.size(); ++i) 
-            show_bam_alignment(buf.bam_buf, query, alns[i], i == primary);
-    #endif
+    if (!showCalls && !countCalls) {
+        if (opt.output.samMode == sam_mode::sam)
+            for (size_t i = 0; i < alns.size(); ++i)
+                show_sam_alignment(buf.align_out, db, query, alns[i], i == primary);
+        
+        #ifdef RMA_BAM
+        else if (htslib_output(opt.output.samMode))
+            for (size_t i = 0; i < alns.size(); ++i) 
+                show_bam_alignment(buf.bam_buf, query, alns[i], i == primary);
+        #endif
+        return;
+    }
+
+    // single pass: calls are made while alignments are written;
+    // only primary alignments are counted
+    const conversion_caller callConversions {db};
+    conversion_caller::mate_calls calls1, calls2;
+    const auto* tags1 = showCalls ? &calls1 : nullptr;
+    const auto* tags2 = showCalls ? &calls2 : nullptr;
+
+    for (size_t i = 0; i < alns.size(); ++i) {
+        const bool isPrimary = i == primary;
+        if (showCalls || isPrimary) {
+            callConversions(query, alns[i], calls1, calls2,
+                            (countCalls && isPrimary) ? &buf.conversions : nullptr);
+        }
+
+        if (opt.output.samMode == sam_mode::sam)
+            show_sam_alignment(buf.align_out, db, query, alns[i], isPrimary, tags1, tags2);
+        #ifdef RMA_BAM
+        else if (htslib_output(opt.output.samMode))
+            show_bam_alignment(buf.bam_buf, query, alns[i], isPrimary, tags1, tags2);
+        #endif
+    }
 }
 
 
 /*************************************************************************//**
  *
  * @brief classification scheme 2-pass variant;
- *        saves memory at expense of speed
+ *        saves memory at expense of speed;
+ *        each read is parsed once and mapped against all databases
  *
  *****************************************************************************/
 void map_queries_to_targets_2pass(
     const vector<string>& infiles,
-    const database& db, const query_options& opt,
-    classification_results& results)
+    const vector<const database*>& dbs, const query_options& opt,
+    const vector<classification_results*>& results)
 {
-    matches_per_target_light coverage_;
+    const auto numDbs = dbs.size();
+    const bool combined = opt.output.combineDatabases && numDbs > 1;
+
+    vector<lookup_statistics*> lookups;
+    for (auto res : results) lookups.push_back(&res->lookups);
+
+    vector<matches_per_target_light> coverageMaps(numDbs);
 
-    const auto makeCovBuffer = [] { return matches_per_target_light(); };
+    const auto makeCovBuffer = [numDbs] {
+        return vector<matches_per_target_light>(numDbs);
+    };
 
-    const auto processCoverage = [&] (matches_per_target_light& buf,
-        const sequence_query& query, const auto& allhits)
+    const auto processCoverage = [&] (vector<matches_per_target_light>& buf,
+        std::size_t dbi, const lazy_sequence_query& query, const auto& allhits)
     {
         if (query.empty()) return;
 
-        for_each_eligible_mapping(db, opt.classify, query, allhits, [&](const auto& cand) {
-            buf.insert(allhits, cand, opt.classify.covFill);
+        for_each_eligible_mapping(*dbs[dbi], opt.classify, query, allhits, [&](const auto& cand) {
+            buf[dbi].insert(allhits, cand, opt.classify.covFill);
         });
     };
 
-    const auto mergeCoverage = [&] (matches_per_target_light&& buf) {
-        coverage_.merge(std::move(buf));
+    const auto mergeCoverage = [&] (vector<matches_per_target_light>&& buf) {
+        for (std::size_t i = 0; i < numDbs; ++i) {
+            coverageMaps[i].merge(std::move(buf[i]));
+        }
     };
 
     const auto appendToOutput = [] (const std::string&) {
         // nothing because we might need an intact sam file
     };
 
-    // 1st pass: generate coverage
-    query_database(infiles, db, opt.pairing, opt.performance,
-                   makeCovBuffer, processCoverage, mergeCoverage,
-                   appendToOutput);
-    
-    if (opt.output.samMode == sam_mode::sam)
-        db.show_sam_header(results.samOut);
-    #ifdef RMA_BAM
-    else if (opt.output.samMode == sam_mode::bam)
-        prepare_bam(db, opt, results);
-    #endif
+    const auto& checkpointFile = opt.checkpoint.filename;
+    query_checkpoint checkpoint;
+
+    const bool resumed = opt.checkpoint.resume && !checkpointFile.empty() &&
+                         read_query_checkpoint(checkpointFile, checkpoint);
+
+    // coverage of 1st pass is part of the checkpoint
+    auto& coverage_ = checkpoint.coverage;
+
+    if (resumed) {
+        bool matches = checkpoint.infiles == infiles &&
+                       checkpoint.coverage.size() == numDbs;
+        for (std::size_t i = 0; matches && i < numDbs; ++i) {
+            matches = coverage_[i].size() == dbs[i]->target_count();
+        }
+        if (!matches) {
+            throw std::runtime_error{"Checkpoint " + checkpointFile +
+                " doesn't match the input files and databases!"};
+        }
+        for (std::size_t i = 0; i < numDbs; ++i) {
+            results[i]->statistics.restore(checkpoint.statistics[i]);
+            results[i]->lookups.restore(checkpoint.lookups[i]);
+        }
+    }
+    else {
+        // coverage may be estimated from a subsample of the queries
+        auto covOpt = opt;
+        covOpt.performance.queryFraction = coverage_sample_fraction(infiles, opt);
+
+        // 1st pass: generate coverage
+        query_databases(infiles, dbs, covOpt, lookups,
+                        makeCovBuffer, processCoverage, mergeCoverage,
+                        appendToOutput);
+
+        // freeze coverage; pass 1 maps are no longer needed
+        coverage_.reserve(numDbs);
+        for (std::size_t i = 0; i < numDbs; ++i) {
+            coverage_.emplace_back(*dbs[i], coverageMaps[i],
+                                   covOpt.performance.queryFraction);
+            coverageMaps[i] = matches_per_target_light{};
+        }
+
+        for (std::size_t i = 0; i < numDbs; ++i) {
+            if (opt.output.samMode == sam_mode::sam)
+                dbs[i]->show_sam_header(results[i]->samOut);
+            #ifdef RMA_BAM
+            else if (htslib_output(opt.output.samMode))
+                prepare_bam(*dbs[i], opt, *results[i]);
+            #endif
+        }
+    }
+
+    query_checkpointing checkpointing;
+    if (!checkpointFile.empty()) {
+        checkpointing.interval = std::size_t(opt.checkpoint.interval);
+        checkpointing.start = checkpoint.input;
+        checkpointing.save = [&] (const query_input_position& pos) {
+            checkpoint.infiles = infiles;
+            checkpoint.input = pos;
+            checkpoint.outputs.clear();
+            checkpoint.statistics.clear();
+            checkpoint.lookups.clear();
+            for (auto res : results) {
+                res->flush_all_streams();
+                checkpoint.outputs.push_back(query_output_positions{
+                    std::uint64_t(std::streamoff(res->mainOut.tellp())),
+                    std::uint64_t(std::streamoff(res->samOut.tellp())) });
+                checkpoint.statistics.push_back(res->statistics.snapshot());
+                checkpoint.lookups.push_back(res->lookups.snapshot());
+            }
+            write_query_checkpoint(checkpointFile, checkpoint);
+        };
+        // state after 1st pass
+        if (!resumed) checkpointing.save(checkpoint.input);
+    }
 
     const auto makeBatchBuffer = [&] {
-        #ifdef RMA_BAM
-        if (opt.output.samMode == sam_mode::bam)
-            return mappings_buffer(opt.performance.bamBufSize);
-        else
-        #endif
-            return mappings_buffer();
+        multi_mappings_buffer buf;
+        for (std::size_t i = 0; i < numDbs; ++i) {
+            #ifdef RMA_BAM
+            if (htslib_output(opt.output.samMode))
+                buf.dbs.emplace_back(opt.performance.bamBufSize);
+            else
+            #endif
+                buf.dbs.emplace_back();
+
+            if (results[i]->binaryOut) {
+                buf.dbs.back().binary = results[i]->binaryOut->make_block();
+            }
+        }
+        return buf;
     };
 
-    const auto processQuery = [&] (mappings_buffer& buf,
-        const sequence_query& query, const auto& allhits)
+    const auto processQuery = [&] (multi_mappings_buffer& mbuf,
+        std::size_t dbi, const lazy_sequence_query& query, const auto& allhits)
     {
         if (query.empty()) return;
 
-        classification cls = classify(db, opt.classify, query, allhits, coverage_);
+        const auto& db = *dbs[dbi];
+        auto& buf = mbuf.dbs[dbi];
+
+        classification cls = classify(db, opt.classify, query, allhits, coverage_[dbi]);
        
         if (opt.output.evaluate.determineGroundTruth)
-            cls.groundTruth = ground_truth_target(db, query.header);
+            cls.groundTruth = ground_truth_target(db, query.header());
+
+        buf.alignments.clear();
+        buf.primary = -1;
 
         if (opt.classify.align)
             align_candidates(buf, db, opt, query, cls.candidates); // removes unalignable candidates
         else
             show_as_alignment(buf, db, opt, query, cls.candidates);
 
-        show_query_mapping(buf.out, db, opt.output, query, cls, allhits);
+        if (results[dbi]->binaryOut &&
+            (opt.output.format.showUnmapped || !cls.candidates.empty()))
+        {
+            buf.binary.add(query, cls.candidates, buf.alignments, buf.primary);
+            // blocks are compressed by the worker threads
+            if (buf.binary.full()) buf.binary.seal(buf.binaryBlocks);
+        }
+
+        if (!combined) {
+            show_query_mapping(buf.out, db, opt.output, query, cls, allhits);
+        }
+        else if (opt.output.format.showMapping) {
+            // databases are processed in order for each query
+            if (dbi == 0) {
+                mbuf.line.str("");
+                mbuf.mapped = false;
+                show_query_header_columns(mbuf.line, opt.output.format, query);
+            }
+            show_query_mapping_columns(mbuf.line, db, opt.output, cls, allhits);
+            mbuf.mapped = mbuf.mapped || !cls.candidates.empty();
+
+            if (dbi+1 == numDbs && (mbuf.mapped || opt.output.format.showUnmapped)) {
+                mbuf.dbs.front().out << mbuf.line.str() << '\n';
+            }
+        }
             
-        evaluate_classification(opt.output.evaluate, cls, results.statistics);
+        evaluate_classification(opt.output.evaluate, cls, results[dbi]->statistics);
     };
 
-    const auto finalizeBatch = [&] (mappings_buffer&& buf) {
-        results.mainOut << buf.out.str();
-        results.samOut << buf.align_out.str();
+    const auto finalizeBatch = [&] (multi_mappings_buffer&& mbuf) {
+        for (std::size_t i = 0; i < numDbs; ++i) {
+            auto& buf = mbuf.dbs[i];
+            auto& res = *results[i];
 
-        #ifdef RMA_BAM
-        if (opt.output.samMode == sam_mode::bam) {
-            for (bam1_t& aln: buf.bam_buf.vec) {
-                sam_write1(results.bamOut, results.bamHdr, &aln); //TODO: handle errors
-                bam_destroy1(&aln);
+            res.mainOut << buf.out.str();
+            res.samOut << buf.align_out.str();
+
+            if (!buf.conversions.empty()) {
+                res.conversions.merge(std::move(buf.conversions));
+            }
+
+            if (res.binaryOut) {
+                buf.binary.seal(buf.binaryBlocks);
+                res.binaryOut->write(buf.binaryBlocks);
             }
+
+            #ifdef RMA_BAM
+            if (htslib_output(opt.output.samMode)) {
+                for (bam1_t& aln: buf.bam_buf.vec) {
+                    sam_write1(res.bamOut, res.bamHdr, &aln); //TODO: handle errors
+                    bam_destroy1(&aln);
+                }
+            }
+            #endif
         }
-        #endif
     };
 
     // 2nd pass: process queries
-    query_database(infiles, db, opt.pairing, opt.performance,
-                   makeBatchBuffer, processQuery, finalizeBatch,
-                   appendToOutput);
+    batch_statistics batching;
+    query_databases(infiles, dbs, opt, lookups,
+                    makeBatchBuffer, processQuery, finalizeBatch,
+                    appendToOutput, checkpointing, &batching);
+
+    for (auto res : results) res->batching = batching;
+
+    // run complete => checkpoint no longer needed
+    if (!checkpointFile.empty()) std::remove(checkpointFile.c_str());
 
     #ifdef RMA_BAM
-    if (results.bamOut) sam_close(results.bamOut);
-    if (results.bamHdr) sam_hdr_destroy(results.bamHdr);
+    for (auto res : results) {
+        if (res->bamOut) sam_close(res->bamOut);
+        if (res->bamHdr) sam_hdr_destroy(res->bamHdr);
+        // CRAM reference is only needed until all containers are written
+        res->cramRef.reset();
+    }
     #endif
 }
 
+/*************************************************************************//**
+ *
+ * @brief parameter sweep: evaluates a grid of classification thresholds
+ *        (hitsMin x hitsCutoff x covMin) in one 2-pass run;
+ *        1st pass records the highest thresholds with which each
+ *        target window would be covered (matches_per_target_param),
+ *        2nd pass classifies each query once per grid point;
+ *        each read is parsed once per pass and mapped against all databases
+ *
+ *****************************************************************************/
+void map_queries_to_targets_sweep(
+    const vector<string>& infiles,
+    const vector<const database*>& dbs, const query_options& opt,
+    const vector<classification_results*>& results)
+{
+    const auto numDbs = dbs.size();
+    const auto& sweep = opt.sweep;
+
+    // empty dimensions use the regular classification thresholds
+    const auto hitsMins = sweep.hitsMin.empty()
+        ? vector<int>{opt.classify.hitsMin} : sweep.hitsMin;
+    const auto hitsCutoffs = sweep.hitsCutoff.empty()
+        ? vector<double>{opt.classify.hitsCutoff} : sweep.hitsCutoff;
+    const auto covMins = sweep.covMin.empty()
+        ? vector<double>{opt.classify.covMin} : sweep.covMin;
+
+    // candidates are generated with the least restrictive thresholds
+    auto candOpt = opt.classify;
+    candOpt.hitsMin = *std::min_element(hitsMins.begin(), hitsMins.end());
+    candOpt.hitsCutoff = *std::min_element(hitsCutoffs.begin(), hitsCutoffs.end());
+
+    // thresholds are evaluated separately for each database
+    for (auto res : results) {
+        res->sweep.clear();
+        for (auto hmin : hitsMins) {
+            for (auto hcut : hitsCutoffs) {
+                for (auto cmin : covMins) {
+                    res->sweep.emplace_back(hmin, hcut, cmin);
+                }
+            }
+        }
+    }
+
+    vector<lookup_statistics*> lookups;
+    for (auto res : results) lookups.push_back(&res->lookups);
+
+    vector<matches_per_target_param> coverageParams(numDbs);
+
+    const auto makeCovBuffer = [numDbs] {
+        return vector<matches_per_target_param>(numDbs);
+    };
+
+    const auto processCoverage = [&] (vector<matches_per_target_param>& buf,
+        std::size_t dbi, const lazy_sequence_query& query, const auto& allhits)
+    {
+        if (query.empty()) return;
+
+        buf[dbi].insert(allhits,
+                   make_classification_candidates(*dbs[dbi], candOpt, query, allhits),
+                   opt.classify.covFill);
+    };
+
+    const auto mergeCoverage = [&] (vector<matches_per_target_param>&& buf) {
+        for (std::size_t i = 0; i < numDbs; ++i) {
+            coverageParams[i].merge(std::move(buf[i]));
+        }
+    };
+
+    const auto appendToOutput = [] (const std::string&) {};
+
+    // 1st pass: record coverage thresholds
+    query_databases(infiles, dbs, opt, lookups,
+                    makeCovBuffer, processCoverage, mergeCoverage,
+                    appendToOutput);
+
+    // coverage per target for each database and (hitsMin, hitsCutoff) pair
+    vector<vector<coverage_per_target>> coverage(numDbs);
+    for (std::size_t i = 0; i < numDbs; ++i) {
+        coverage[i].reserve(hitsMins.size() * hitsCutoffs.size());
+        for (auto hmin : hitsMins) {
+            for (auto hcut : hitsCutoffs) {
+                coverage[i].emplace_back(*dbs[i], coverageParams[i], hmin, hcut);
+            }
+        }
+        coverageParams[i] = matches_per_target_param{};
+    }
+
+    const auto makeBatchBuffer = [] { return 0; };
+
+    const auto processQuery = [&] (int&,
+        std::size_t dbi, const lazy_sequence_query& query, const auto& allhits)
+    {
+        if (query.empty()) return;
+
+        const auto& db = *dbs[dbi];
+        auto& points = results[dbi]->sweep;
+
+        const auto cands = make_classification_candidates(db, candOpt, query, allhits);
+
+        const target_id groundTruth = opt.output.evaluate.determineGroundTruth
+            ? ground_truth_target(db, query.header()) : database::nulltgt;
+
+        auto clsOpt = opt.classify;
+        std::size_t point = 0;
+
+        for (std::size_t i = 0; i < hitsMins.size(); ++i) {
+            clsOpt.hitsMin = hitsMins[i];
+            for (std::size_t j = 0; j < hitsCutoffs.size(); ++j) {
+                clsOpt.hitsCutoff = hitsCutoffs[j];
+
+                auto hitsFiltered = cands;
+                hits_cutoff_filter(clsOpt, hitsFiltered);
+
+                const auto& cov = coverage[dbi][i * hitsCutoffs.size() + j];
+
+                for (auto cmin : covMins) {
+                    clsOpt.covMin = cmin;
+
+                    classification cls{hitsFiltered};
+                    cls.groundTruth = groundTruth;
+                    coverage_filter(clsOpt, cls.candidates, cov);
+
+                    evaluate_classification(opt.output.evaluate, cls,
+                                            points[point].statistics);
+                    ++point;
+                }
+            }
+        }
+    };
+
+    const auto finalizeBatch = [] (int&&) {};
+
+    // 2nd pass: classify each query for all grid points
+    query_databases(infiles, dbs, opt, lookups,
+                    makeBatchBuffer, processQuery, finalizeBatch,
+                    appendToOutput);
+}
+
+
+
 /*************************************************************************//**
  *
  * @brief classification scheme
@@ -993,9 +1373,48 @@ void map_queries_to_targets(const vector<string>& infiles,
                             const query_options& opt,
                             classification_results& results)
 {
-    if (opt.output.format.showMapping)
+    if (opt.sweep.active()) {
+        map_queries_to_targets_sweep(infiles, {&db}, opt, {&results});
+        return;
+    }
+    // a resumed run appends to existing output
+    if (opt.output.format.showMapping && !opt.checkpoint.resume)
         show_query_mapping_header(results.mainOut, opt.output);
-    map_queries_to_targets_2pass(infiles, db, opt, results);
+    map_queries_to_targets_2pass(infiles, {&db}, opt, {&results});
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief classification scheme for multiple databases
+ *
+ *****************************************************************************/
+void map_queries_to_targets(const vector<string>& infiles,
+                            const vector<const database*>& dbs,
+                            const vector<string>& dbNames,
+                            const query_options& opt,
+                            const vector<classification_results*>& results)
+{
+    if (dbs.empty() || dbs.size() != results.size()) return;
+
+    if (opt.sweep.active()) {
+        map_queries_to_targets_sweep(infiles, dbs, opt, results);
+        return;
+    }
+
+    // a resumed run appends to existing output
+    if (opt.output.format.showMapping && !opt.checkpoint.resume) {
+        if (opt.output.combineDatabases && dbs.size() > 1) {
+            show_query_mapping_header(results.front()->mainOut, opt.output, dbNames);
+        }
+        else {
+            for (auto res : results) {
+                show_query_mapping_header(res->mainOut, opt.output);
+            }
+        }
+    }
+    map_queries_to_targets_2pass(infiles, dbs, opt, results);
 }
 
 
@@ -23,9 +23,14 @@
 #define RMA_CLASSIFY_COMMON_H_
 
 
+#include <deque>
+#include <memory>
+
 #include "config.h"
+#include "binary_mappings.h"
 #include "candidates.h"
 #include "classification_statistics.h"
+#include "conversion_calling.h"
 #include "sequence_view.h"
 #include "timer.h"
 #include "querying.h"
@@ -33,11 +38,16 @@
 
 #ifdef RMA_BAM
 #include "sam.h"
+#include "cram_reference.h"
 #endif
 
 namespace mc {
 
 
+/// @brief forward declarations
+class coverage_per_target;
+
+
 
 /*************************************************************************//**
  *
@@ -56,6 +66,25 @@ struct classification
 
 
 
+/*************************************************************************//**
+ *
+ * @brief statistics of one parameter combination of a parameter sweep
+ *
+ *****************************************************************************/
+struct parameter_sweep_point
+{
+    parameter_sweep_point(int hmin, double hcut, double cmin):
+        hitsMin{hmin}, hitsCutoff{hcut}, covMin{cmin}
+    {}
+
+    int hitsMin;
+    double hitsCutoff;
+    double covMin;
+    mapping_statistics statistics;
+};
+
+
+
 /*************************************************************************//**
  *
  * @brief classification result target
@@ -81,10 +110,25 @@ struct classification_results
     timer time;
 
     mapping_statistics statistics;
+    lookup_statistics lookups;
+    batch_statistics batching;
+
+    // only filled in parameter sweep mode
+    std::deque<parameter_sweep_point> sweep;
+
+    // only filled if a conversion table is requested
+    conversion_counts conversions;
+    std::string conversionTableFile;
+
+    // only set if binary mapping output is requested
+    std::unique_ptr<binary_mapping_writer> binaryOut;
 
     #ifdef RMA_BAM
+    std::string bamFilename;
     samFile* bamOut = nullptr;
     sam_hdr_t* bamHdr = nullptr;
+    // only set for CRAM output
+    std::unique_ptr<cram_reference> cramRef;
     #endif
 };
 
@@ -101,6 +145,27 @@ ground_truth_target(const database&, const std::string& header);
 
 
 
+/*************************************************************************//**
+ *
+ * @brief removes candidates below the 'hitsMin' and 'hitsCutoff' thresholds
+ *
+ *****************************************************************************/
+void hits_cutoff_filter(const classification_options&,
+                        classification_candidates&);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief removes candidates with a target coverage below 'covMin'
+ *
+ *****************************************************************************/
+void coverage_filter(const classification_options&,
+                     classification_candidates&,
+                     const coverage_per_target&);
+
+
+
 /*************************************************************************//**
  *
  * @brief print header line for mapping table
@@ -109,6 +174,16 @@ ground_truth_target(const database&, const std::string& header);
 void show_query_mapping_header(std::ostream&,
                                const classification_output_options&);
 
+/*************************************************************************//**
+ *
+ * @brief print header line for combined mapping table
+ *        with one group of result columns per database
+ *
+ *****************************************************************************/
+void show_query_mapping_header(std::ostream&,
+                               const classification_output_options&,
+                               const std::vector<std::string>& dbNames);
+
 
 
 /*************************************************************************//**
@@ -120,16 +195,16 @@ template<class Locations>
 classification_candidates
 make_classification_candidates(const database& db,
                                const classification_options& opt,
-                               const sequence_query& query,
+                               const lazy_sequence_query& query,
                                const Locations& allhits)
 {
     candidate_generation_rules rules;
 
-    rules.maxWindowsInRange = window_id( 2 + (
-        std::max(query.seq1.size() + query.seq2.size(), opt.insertSizeMax) /
-        db.target_sketcher().window_stride() ));
+    rules.maxWindowsInRange = max_windows_in_range(db, opt, query.length());
 
     rules.maxCandidates = opt.maxNumCandidatesPerQuery;
+    rules.hitsMin = opt.hitsMin;
+    rules.hitsCutoff = opt.hitsCutoff;
 
     return classification_candidates{allhits, rules};
 
@@ -138,44 +213,49 @@ make_classification_candidates(const database& db,
 
 /*************************************************************************//**
  *
- * @brief shows one query mapping line
- *        [query id], query_header, classification [, [top|all]hits list]
- *
- *****************************************************************************/
-/*************************************************************************//**
- *
- * @brief shows one query mapping line
- *        [query id], query_header, classification [, [top|all]hits list]
+ * @brief shows leading columns of a query mapping line
+ *        [query id], query_header
  *
  *****************************************************************************/
-template<class Locations>
-void show_query_mapping(
-    std::ostream& os,
-    const database& db,
-    const classification_output_options& opt,
-    const sequence_query& query,
-    const classification& cls,
-    const Locations& allhits)
+inline void
+show_query_header_columns(std::ostream& os,
+                          const classification_output_formatting& fmt,
+                          const lazy_sequence_query& query)
 {
-    const auto& fmt = opt.format;
-
-    if (!fmt.showMapping || (!fmt.showUnmapped && cls.candidates.empty()))
-        return;
-
     const auto& colsep = fmt.tokens.column;
 
-    if (fmt.showQueryIds) os << query.id << colsep;
+    if (fmt.showQueryIds) os << query.id() << colsep;
 
     //print query header (first contiguous string only)
-    auto l = query.header.find(' ');
+    const auto& header = query.header();
+    auto l = header.find(' ');
     if (l != std::string::npos) {
         auto oit = std::ostream_iterator<char>{os, ""};
-        std::copy(query.header.begin(), query.header.begin() + l, oit);
+        std::copy(header.begin(), header.begin() + l, oit);
     }
     else {
-        os << query.header;
+        os << header;
     }
     os << colsep;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief shows mapping result columns of a query mapping line
+ *        [ground truth], [all hits], top hits, [candidate locations]
+ *
+ *****************************************************************************/
+template<class Locations>
+void show_query_mapping_columns(
+    std::ostream& os,
+    const database& db,
+    const classification_output_options& opt,
+    const classification& cls,
+    const Locations& allhits)
+{
+    const auto& colsep = opt.format.tokens.column;
 
     if (opt.evaluate.showGroundTruth) {
         show_target(os, db, opt.format, cls.groundTruth);
@@ -187,13 +267,39 @@ void show_query_mapping(
         os << colsep;
     }
     
-    show_candidates(os, db, cls.candidates);
+    show_candidates(os, db, cls.candidates, opt.format.showAliases);
     os << colsep;
     
     if (opt.analysis.showLocations) {
         show_candidate_ranges(os, db, cls.candidates);
         os << colsep;
     }
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief shows one query mapping line
+ *        [query id], query_header, classification [, [top|all]hits list]
+ *
+ *****************************************************************************/
+template<class Locations>
+void show_query_mapping(
+    std::ostream& os,
+    const database& db,
+    const classification_output_options& opt,
+    const lazy_sequence_query& query,
+    const classification& cls,
+    const Locations& allhits)
+{
+    const auto& fmt = opt.format;
+
+    if (!fmt.showMapping || (!fmt.showUnmapped && cls.candidates.empty()))
+        return;
+
+    show_query_header_columns(os, fmt, query);
+    show_query_mapping_columns(os, db, opt, cls, allhits);
 
     os << '\n';
 }
@@ -105,14 +105,15 @@ using feature_hash = same_size_hash<typename sketcher::feature_type>;
 
 /**************************************************************************
  * @brief controls how a classification is derived from a location hit list;
- *        default is a top 2 voting scheme;
+ *        default keeps the top 'maxNumCandidatesPerQuery' candidates;
  *        forward declarations (breaks cycle "config.h" <-> "candidates.h")
  */
 
 class distinct_matches_in_contiguous_window_ranges;
 class best_distinct_matches_in_contiguous_window_ranges;
+class top_distinct_matches_in_contiguous_window_ranges;
 
-using classification_candidates = distinct_matches_in_contiguous_window_ranges;
+using classification_candidates = top_distinct_matches_in_contiguous_window_ranges;
 
 } // namespace mc
 
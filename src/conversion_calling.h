@@ -0,0 +1,407 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#ifndef RMA_CONVERSION_CALLING_H_
+#define RMA_CONVERSION_CALLING_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "alignment.h"
+#include "database.h"
+#include "dna_encoding.h"
+#include "io_error.h"
+#include "querying.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief per reference position numbers of converted and unconverted
+ *        read nucleotides (= unmethylated / methylated for C->T);
+ *        only positions with calls are stored
+ *
+ *****************************************************************************/
+class conversion_counts
+{
+public:
+    //---------------------------------------------------------------
+    struct position {
+        target_id tgt;
+        std::uint64_t pos;
+
+        friend bool
+        operator == (const position& a, const position& b) noexcept {
+            return a.tgt == b.tgt && a.pos == b.pos;
+        }
+        friend bool
+        operator < (const position& a, const position& b) noexcept {
+            return a.tgt < b.tgt || (a.tgt == b.tgt && a.pos < b.pos);
+        }
+    };
+
+    struct counts {
+        std::uint32_t converted = 0;
+        std::uint32_t unconverted = 0;
+    };
+
+    using entry = std::pair<position,counts>;
+
+
+    //---------------------------------------------------------------
+    void add(target_id tgt, std::uint64_t pos, bool converted) {
+        auto& c = counts_[position{tgt, pos}];
+        if (converted) ++c.converted; else ++c.unconverted;
+    }
+
+    //---------------------------------------------------------------
+    void merge(conversion_counts&& other)
+    {
+        if (counts_.empty()) {
+            counts_ = std::move(other.counts_);
+        }
+        else {
+            for (const auto& x : other.counts_) {
+                auto& c = counts_[x.first];
+                c.converted += x.second.converted;
+                c.unconverted += x.second.unconverted;
+            }
+        }
+        other.counts_.clear();
+    }
+
+    //---------------------------------------------------------------
+    bool empty() const noexcept { return counts_.empty(); }
+    std::size_t size() const noexcept { return counts_.size(); }
+
+    void clear() { counts_.clear(); }
+
+    //---------------------------------------------------------------
+    /// @return all entries ordered by target and position
+    std::vector<entry> sorted() const
+    {
+        std::vector<entry> entries {counts_.begin(), counts_.end()};
+        std::sort(entries.begin(), entries.end(),
+            [] (const entry& a, const entry& b) { return a.first < b.first; });
+        return entries;
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    struct position_hash {
+        std::size_t operator () (const position& p) const noexcept {
+            // 64 bit mix of target and position
+            std::uint64_t h = (std::uint64_t(p.tgt) * 0x9E3779B97F4A7C15ULL) ^ p.pos;
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDULL;
+            h ^= h >> 33;
+            return std::size_t(h);
+        }
+    };
+
+    std::unordered_map<position,counts,position_hash> counts_;
+};
+
+
+
+
+/*************************************************************************//**
+ *
+ * @brief Bismark-style conversion (methylation) calls of aligned reads
+ *
+ *        Reference positions with the original nucleotide of the
+ *        conversion rule on the genome strand of the read fragment
+ *        (e.g. 'C' for C->T) are called as converted if the read shows
+ *        the replacement nucleotide and as unconverted if it shows the
+ *        original one. XM codes (lower case: converted):
+ *            z/Z: CpG,  x/X: CHG,  h/H: CHH,  u/U: unknown context
+ *        (contexts of other conversion rules are defined analogously
+ *        with the complement of the original nucleotide instead of 'G')
+ *
+ *        Libraries are assumed to be directional: mate 1 stems from the
+ *        genome strand it aligns to, mate 2 from the opposite strand.
+ *
+ *****************************************************************************/
+class conversion_caller
+{
+public:
+    //---------------------------------------------------------------
+    /// @brief SAM tags of one mate; empty if the mate is unaligned
+    struct mate_calls {
+        std::string xm;   // call per read nucleotide
+        std::string xr;   // read conversion
+        std::string xg;   // genome conversion
+
+        bool empty() const noexcept { return xm.empty(); }
+    };
+
+
+    //---------------------------------------------------------------
+    explicit
+    conversion_caller(const database& db):
+        db_{db},
+        orig_{upper(db.query_sketcher().conversion_original())},
+        repl_{upper(db.query_sketcher().conversion_replacement())},
+        origRc_{complement(orig_)},
+        replRc_{complement(repl_)}
+    {}
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief calls conversions of both mates;
+     *        calls are counted in 'counts' (if not null);
+     *        positions that are covered by both mates are only counted once
+     */
+    void operator () (const sequence_query& query,
+                      const edlib_alignment_pair& aln,
+                      mate_calls& calls1, mate_calls& calls2,
+                      conversion_counts* counts = nullptr) const
+    {
+        call(query.seq1, aln.first, aln.tgt(), false, 1, 0, calls1, counts);
+
+        if (aln.first.aligned()) {
+            call(query.seq2, aln.second, aln.tgt(), true,
+                 aln.first.start(), aln.first.end(), calls2, counts);
+        } else {
+            call(query.seq2, aln.second, aln.tgt(), true, 1, 0, calls2, counts);
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @return upper case XM context code of a reference position with
+     *         the original nucleotide on the top strand or its complement
+     *         on the bottom strand; '.' for all other positions
+     */
+    char context(const sequence& ref, std::uint64_t pos) const noexcept
+    {
+        const char c = upper(ref[pos]);
+        if (c == orig_) {
+            // downstream on top strand
+            return context_code(next(ref, pos, 1), next(ref, pos, 2), origRc_);
+        }
+        if (c == origRc_) {
+            // downstream on bottom strand
+            return context_code(prev(ref, pos, 1), prev(ref, pos, 2), orig_);
+        }
+        return '.';
+    }
+
+    //---------------------------------------------------------------
+    /// @return '+' for calls on the top strand, '-' for the bottom strand
+    char strand(const sequence& ref, std::uint64_t pos) const noexcept {
+        return upper(ref[pos]) == orig_ ? '+' : '-';
+    }
+
+    //---------------------------------------------------------------
+    static const char* context_name(char code) noexcept {
+        switch (code) {
+            case 'Z': case 'z': return "CG";
+            case 'X': case 'x': return "CHG";
+            case 'H': case 'h': return "CHH";
+            default:            return "unknown";
+        }
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    static constexpr char upper(char c) noexcept {
+        return (c >= 'a' && c <= 'z') ? char(c - 'a' + 'A') : c;
+    }
+
+    static constexpr char lower(char c) noexcept {
+        return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+    }
+
+    static constexpr char complement(char c) noexcept {
+        switch (c) {
+            case 'A': return 'T';
+            case 'C': return 'G';
+            case 'G': return 'C';
+            case 'T': return 'A';
+            default:  return c;
+        }
+    }
+
+    static constexpr bool nucleotide(char c) noexcept {
+        return c == 'A' || c == 'C' || c == 'G' || c == 'T';
+    }
+
+    //---------------------------------------------------------------
+    static char next(const sequence& ref, std::uint64_t pos, std::uint64_t d) noexcept {
+        return pos + d < ref.size() ? upper(ref[pos + d]) : 'N';
+    }
+
+    static char prev(const sequence& ref, std::uint64_t pos, std::uint64_t d) noexcept {
+        return pos >= d ? complement(upper(ref[pos - d])) : 'N';
+    }
+
+    //---------------------------------------------------------------
+    /// @param n1,n2  next two nucleotides on the strand of the call
+    static constexpr char
+    context_code(char n1, char n2, char partner) noexcept
+    {
+        if (!nucleotide(n1)) return 'U';
+        if (n1 == partner)   return 'Z';
+        if (!nucleotide(n2)) return 'U';
+        if (n2 == partner)   return 'X';
+        return 'H';
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @param skipBeg,skipEnd  reference range (inclusive) that is not counted
+     */
+    void call(const sequence& read, const edlib_alignment& aln,
+              target_id tgt, bool mate2,
+              std::int64_t skipBeg, std::int64_t skipEnd,
+              mate_calls& calls, conversion_counts* counts) const
+    {
+        calls.xm.clear();
+        if (!aln.aligned() || !aln.cigar()) return;
+
+        const bool reverse = aln.orientation() == edlib_alignment::status::REVERSE;
+        // directional library: mate 2 is from the opposite strand
+        const bool topStrand = reverse == mate2;
+
+        // read in reference orientation (as in SAM SEQ column)
+        const sequence seq = reverse ? make_reverse_complement(read) : read;
+        const sequence& ref = db_.get_target(tgt).seq();
+
+        const char callNuc = topStrand ? orig_ : origRc_;
+        const char convNuc = topStrand ? repl_ : replRc_;
+
+        calls.xm.assign(seq.size(), '.');
+        calls.xr = mate2 ? rule(origRc_, replRc_) : rule(orig_, repl_);
+        calls.xg = topStrand ? rule(orig_, repl_) : rule(origRc_, replRc_);
+
+        std::size_t r = 0;
+        std::uint64_t t = std::uint64_t(aln.start());
+
+        for (const char* c = aln.cigar(); *c != '\0'; ) {
+            std::size_t n = 0;
+            while (*c >= '0' && *c <= '9') n = 10 * n + std::size_t(*c++ - '0');
+            const char op = *c;
+            if (op == '\0') break;
+            ++c;
+
+            switch (op) {
+                case 'M': case '=': case 'X':
+                    for (; n > 0 && r < seq.size() && t < ref.size(); --n, ++r, ++t) {
+                        if (upper(ref[t]) != callNuc) continue;
+                        const char b = upper(seq[r]);
+                        const bool converted = (b == convNuc);
+                        if (!converted && b != callNuc) continue;
+
+                        const char code = context(ref, t);
+                        calls.xm[r] = converted ? lower(code) : code;
+
+                        if (counts && (std::int64_t(t) < skipBeg ||
+                                       std::int64_t(t) > skipEnd))
+                        {
+                            counts->add(tgt, t, converted);
+                        }
+                    }
+                    break;
+                case 'I': case 'S':
+                    r += n;
+                    break;
+                case 'D': case 'N':
+                    t += n;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    //---------------------------------------------------------------
+    static std::string rule(char orig, char repl) {
+        return std::string{orig, repl};
+    }
+
+
+    //---------------------------------------------------------------
+    const database& db_;
+    char orig_;
+    char repl_;
+    char origRc_;
+    char replRc_;
+};
+
+
+
+
+/*************************************************************************//**
+ *
+ * @brief writes a per-position conversion count table (tab separated):
+ *        target, position (1-based), strand, unconverted, converted, context
+ *
+ * @throws file_write_error
+ *
+ *****************************************************************************/
+inline void
+write_conversion_table(const std::string& filename, const database& db,
+                       const conversion_counts& counts)
+{
+    std::ofstream os {filename};
+    if (!os.good()) {
+        throw file_write_error{"Could not write to file " + filename};
+    }
+
+    const conversion_caller caller {db};
+
+    os << "# target\tposition\tstrand\tunconverted\tconverted\tcontext\n";
+
+    for (const auto& e : counts.sorted()) {
+        const auto& tgt = db.get_target(e.first.tgt);
+        const auto pos = e.first.pos;
+        os << tgt.header() << '\t'
+           << (pos + 1) << '\t'
+           << caller.strand(tgt.seq(), pos) << '\t'
+           << e.second.unconverted << '\t'
+           << e.second.converted << '\t'
+           << conversion_caller::context_name(caller.context(tgt.seq(), pos))
+           << '\n';
+    }
+
+    if (!os.good()) {
+        throw file_write_error{"Could not write to file " + filename};
+    }
+}
+
+
+} // namespace mc
+
+
+#endif
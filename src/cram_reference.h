@@ -0,0 +1,135 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#ifndef RMA_CRAM_REFERENCE_H_
+#define RMA_CRAM_REFERENCE_H_
+
+#ifdef RMA_BAM
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <stdlib.h> //POSIX mkdtemp
+
+#include "database.h"
+#include "io_error.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief reference for CRAM encoding made from the database's target
+ *        sequences; htslib only loads CRAM references from an indexed
+ *        FASTA file, so the sequences are written to a temporary
+ *        FASTA + .fai which is removed again on destruction
+ *        (set TMPDIR to a RAM disk to keep it in memory);
+ *        reference names are the target headers up to the first whitespace
+ *        (see database::show_sam_header)
+ *
+ *****************************************************************************/
+class cram_reference
+{
+public:
+    //---------------------------------------------------------------
+    /// @throws file_write_error
+    explicit
+    cram_reference(const database& db)
+    {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        auto tmpl = (fs::temp_directory_path(ec) / "rma3n_cram_XXXXXX").string();
+        if (ec || !mkdtemp(tmpl.data())) {
+            throw file_write_error{"Could not create temporary directory "
+                                   "for CRAM reference"};
+        }
+        dir_ = tmpl;
+        filename_ = dir_ + "/reference.fa";
+
+        std::ofstream fa {filename_, std::ios::binary};
+        std::ofstream fai {filename_ + ".fai"};
+
+        std::uint64_t offset = 0;
+        for (target_id tgt = 0; tgt < db.target_count(); ++tgt) {
+            const auto& target = db.get_target(tgt);
+            const auto& seq = target.seq();
+            const std::string head = '>' + target.header() + '\n';
+            fa << head;
+            offset += head.size();
+
+            // FASTA index name = header up to first whitespace
+            fai << target.header().substr(0, target.header().find_first_of(" \t"))
+                << '\t' << seq.size() << '\t' << offset
+                << '\t' << line_length << '\t' << (line_length + 1) << '\n';
+
+            for (std::size_t i = 0; i < seq.size(); i += line_length) {
+                const auto n = std::min(line_length, seq.size() - i);
+                fa.write(seq.data() + i, std::streamsize(n));
+                fa.put('\n');
+                offset += n + 1;
+            }
+        }
+
+        fa.close();
+        fai.close();
+        if (!fa.good() || !fai.good()) {
+            remove();
+            throw file_write_error{"Could not write CRAM reference " + filename_};
+        }
+    }
+
+    ~cram_reference() { remove(); }
+
+    cram_reference(const cram_reference&) = delete;
+    cram_reference& operator = (const cram_reference&) = delete;
+
+
+    //---------------------------------------------------------------
+    /// @brief FASTA file name (index: filename + ".fai")
+    const std::string& filename() const noexcept { return filename_; }
+
+
+private:
+    //---------------------------------------------------------------
+    void remove() noexcept {
+        std::error_code ec;
+        if (!dir_.empty()) std::filesystem::remove_all(dir_, ec);
+        dir_.clear();
+    }
+
+    static constexpr std::size_t line_length = 60;
+
+    std::string dir_;
+    std::string filename_;
+};
+
+
+} // namespace mc
+
+#endif
+
+#endif
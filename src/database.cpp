@@ -20,11 +20,25 @@
  *
  *****************************************************************************/
 
+#include <algorithm>
+
 #include "database.h"
+#include "filesys_utility.h"
 
 
 namespace mc {
 
+
+namespace {
+
+//-------------------------------------------------------------------
+inline char upper_case(char c) noexcept {
+    return (c >= 'a' && c <= 'z') ? char(c - ('a' - 'A')) : c;
+}
+
+} // namespace
+
+
 // ----------------------------------------------------------------------------
 bool database::add_target(const sequence& seq, target_name sid,
                           file_source source)
@@ -42,6 +56,13 @@ bool database::add_target(const sequence& seq, target_name sid,
     //don't allow non-unique sequence ids
     if (name2tax_.find(sid) != name2tax_.end()) return false;
 
+    const bool dedup = dedup_ != deduplication::none;
+    content_key key;
+    if (dedup) {
+        key = make_content_key(seq);
+        if (add_alias(key, seq, sid, source)) return true;
+    }
+
     const auto targetCount = target_id(targets_.size());
 
     //sketch sequence -> insert features
@@ -50,6 +71,12 @@ bool database::add_target(const sequence& seq, target_name sid,
     //store sequence metadata
     targets_.emplace_back(sid, std::move(source));
 
+    if (dedup) {
+        //later sequences with the same key are compared to this one
+        targets_.back().seq_ = seq;
+        contents_.emplace(key, targetCount);
+    }
+
     //allows lookup via sequence id
     name2tax_.insert({std::move(sid), targetCount});
 
@@ -58,6 +85,67 @@ bool database::add_target(const sequence& seq, target_name sid,
 
 
 
+// ----------------------------------------------------------------------------
+/**
+ * @brief case-insensitive; two different hash functions make
+ *        collisions of sequences with the same length very unlikely
+ */
+database::content_key
+database::make_content_key(const sequence& seq)
+{
+    content_key key;
+    key.length = seq.size();
+
+    // FNV-1a and polynomial rolling hash
+    std::uint64_t h1 = 0xcbf29ce484222325ull;
+    std::uint64_t h2 = 0;
+    for (char c : seq) {
+        const auto u = std::uint8_t(upper_case(c));
+        h1 = (h1 ^ u) * 0x100000001b3ull;
+        h2 = h2 * 0x9e3779b97f4a7c15ull + u + 1;
+    }
+    key.h1 = h1;
+    key.h2 = h2;
+    return key;
+}
+
+
+
+// ----------------------------------------------------------------------------
+/**
+ * @brief stores target as alias if a target with the same sequence
+ *        (case-insensitive) was already added in this session
+ *
+ * @return true, if alias was added
+ */
+bool database::add_alias(const content_key& key, const sequence& seq,
+                         target_name& sid, file_source& source)
+{
+    const auto range = contents_.equal_range(key);
+
+    const auto it = std::find_if(range.first, range.second,
+        [&](const auto& c) {
+            const auto& other = targets_[c.second].seq_;
+            return std::equal(seq.begin(), seq.end(), other.begin(), other.end(),
+                [](char a, char b) { return upper_case(a) == upper_case(b); });
+        });
+
+    if (it == range.second) return false;
+
+    const auto tgt = it->second;
+    // aliases share all windows with their canonical target
+    source.windows = targets_[tgt].source_.windows;
+    targets_[tgt].aliases_.push_back(
+        target::alias{sid, std::move(source)});
+    ++aliasCount_;
+
+    name2tax_.insert({std::move(sid), tgt});
+
+    return true;
+}
+
+
+
 // ----------------------------------------------------------------------------
 void database::read(const std::string& filename, scope what)
 
@@ -115,10 +203,15 @@ void database::read(const std::string& filename, scope what)
     //target metadata
     read_binary(is, targets_);
 
-    //sequence id lookup
+    //sequence id lookup; aliases resolve to their canonical target
     name2tax_.clear();
+    aliasCount_ = 0;
     for (target_id t = 0; t < targets_.size(); ++t) {
         name2tax_.insert({targets_[t].name(), t});
+        for (const auto& a : targets_[t].aliases()) {
+            name2tax_.insert({a.name, t});
+        }
+        aliasCount_ += targets_[t].aliases().size();
     }
 
     if (what == scope::metadata_only) return;
@@ -133,7 +226,8 @@ void database::read(const std::string& filename, scope what)
 
 
 // ----------------------------------------------------------------------------
-void database::write(const std::string& filename) const
+void database::write(const std::string& filename,
+                     int numThreads, bool sync) const
 {
     using std::uint64_t;
     using std::uint8_t;
@@ -164,8 +258,24 @@ void database::write(const std::string& filename) const
     //target metadata
     write_binary(os, targets_);
 
-    //hash table
-    write_binary(os, features_);
+    os.flush();
+    if (!os.good()) {
+        throw file_write_error{"can't write file " + filename};
+    }
+    const auto tableOffset = std::uint64_t(os.tellp());
+    os.close();
+
+    //hash table: batches are written concurrently at their final offsets
+    positional_file_writer out{filename};
+
+    features_.serialize_concurrently(
+        [&] (std::uint64_t offset, const void* data, std::size_t size) {
+            out.write_at(tableOffset + offset, data, size);
+        },
+        numThreads);
+
+    if (sync) out.sync();
+    out.close();
 }
 
 
@@ -236,6 +346,8 @@ database::remove_ambiguous_features(bucket_size_type maxambig)
 void database::clear() {
     targets_.clear();
     name2tax_.clear();
+    contents_.clear();
+    aliasCount_ = 0;
     features_.clear();
 }
 
@@ -247,6 +359,8 @@ void database::clear() {
 void database::clear_without_deallocation() {
     targets_.clear();
     name2tax_.clear();
+    contents_.clear();
+    aliasCount_ = 0;
     features_.clear_without_deallocation();
 }
 
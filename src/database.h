@@ -174,6 +174,13 @@ public:
             index_t index;
         };
 
+        //-----------------------------------------------------
+        /// @brief other reference sequence with identical content
+        struct alias {
+            target_name name;
+            file_source source;
+        };
+
         target() = default;
 
         explicit
@@ -188,6 +195,7 @@ public:
         const file_source& source() const noexcept { return source_; }
         const std::string& header() const noexcept {return header_;}
         const sequence& seq() const noexcept {return seq_;}
+        const std::vector<alias>& aliases() const noexcept {return aliases_;}
 
         //-----------------------------------------------------
         friend
@@ -196,6 +204,15 @@ public:
             read_binary(is, t.source_.filename);
             read_binary(is, t.source_.index);
             read_binary(is, t.source_.windows);
+            std::uint64_t n = 0;
+            read_binary(is, n);
+            t.aliases_.resize(n);
+            for (auto& a : t.aliases_) {
+                read_binary(is, a.name);
+                read_binary(is, a.source.filename);
+                read_binary(is, a.source.index);
+                read_binary(is, a.source.windows);
+            }
         }
 
         //-----------------------------------------------------
@@ -205,12 +222,20 @@ public:
             write_binary(os, t.source_.filename);
             write_binary(os, t.source_.index);
             write_binary(os, t.source_.windows);
+            write_binary(os, std::uint64_t(t.aliases_.size()));
+            for (const auto& a : t.aliases_) {
+                write_binary(os, a.name);
+                write_binary(os, a.source.filename);
+                write_binary(os, a.source.index);
+                write_binary(os, a.source.windows);
+            }
         }
 
         //-----------------------------------------------------
     private:
         target_name name_;
         file_source source_;
+        std::vector<alias> aliases_;
         
         // only used in alignment mode
         std::string header_;
@@ -306,16 +331,26 @@ private:
 
 public:
 
-    void show_sam_header(std::ostream& os) const {
+    /**
+     * @param shortNames  reference names = headers up to first whitespace
+     *                    (as in FASTA indices)
+     */
+    void show_sam_header(std::ostream& os, bool shortNames = false) const {
         os << "@HD\tVN:1.0 SO:unsorted\n";
-        for (const auto& tgt: targets_)
-            os << "@SQ\tSN:" << tgt.header_ << "\tLN:" << tgt.seq_.size() << '\n';
+        for (const auto& tgt: targets_) {
+            os << "@SQ\tSN:";
+            if (shortNames)
+                os << tgt.header_.substr(0, tgt.header_.find_first_of(" \t"));
+            else
+                os << tgt.header_;
+            os << "\tLN:" << tgt.seq_.size() << '\n';
+        }
         os << "@PG\tID:rnaache\tPN:rnaache\tVN:" << RMA_VERSION_STRING << '\n';
     }
 
-    std::string get_sam_header() const {
+    std::string get_sam_header(bool shortNames = false) const {
         std::ostringstream tmp;
-        show_sam_header(tmp);
+        show_sam_header(tmp, shortNames);
         return tmp.str();
     }
 
@@ -323,6 +358,9 @@ public:
     //---------------------------------------------------------------
     using feature_count_type = typename feature_store::size_type;
 
+    /// @brief location list of one feature (see 'find_sketch_locations')
+    using feature_locations = const feature_store::bucket_type*;
+
 
     //---------------------------------------------------------------
     /** @brief used for query result storage/accumulation
@@ -333,6 +371,9 @@ public:
     public:
         void sort() {
             merge_sort(locs_, offsets_, temp_);
+            // sorted range is one chunk for subsequent merges
+            offsets_.resize(1);
+            if (!locs_.empty()) offsets_.push_back(locs_.size());
         }
 
         void clear() {
@@ -393,7 +434,8 @@ public:
         features_{},
         targets_{},
         name2tax_{},
-        inserter_{}
+        inserter_{},
+        contents_{}
     {
         features_.max_load_factor(default_max_load_factor());
     }
@@ -406,7 +448,10 @@ public:
         features_{std::move(other.features_)},
         targets_{std::move(other.targets_)},
         name2tax_{std::move(other.name2tax_)},
-        inserter_{std::move(other.inserter_)}
+        inserter_{std::move(other.inserter_)},
+        dedup_{other.dedup_},
+        aliasCount_{other.aliasCount_},
+        contents_{std::move(other.contents_)}
     {}
 
     database& operator = (const database&) = delete;
@@ -479,6 +524,30 @@ public:
 
 
     //---------------------------------------------------------------
+    /**
+     * @brief targets with identical sequences can be stored as aliases
+     *        of the first target with that sequence; aliases are not
+     *        sketched and resolve to the id of their canonical target;
+     *        (reverse complements can't be aliases: converted k-mers
+     *        are strand-specific)
+     */
+    enum class deduplication : unsigned char {
+        none, identical
+    };
+
+    void target_deduplication(deduplication mode) noexcept {
+        dedup_ = mode;
+    }
+    deduplication target_deduplication() const noexcept {
+        return dedup_;
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @return false, if target wasn't added (empty sequence, duplicate name)
+     *         also true, if target was stored as alias of another target
+     */
     bool add_target(const sequence& seq, target_name sid,
                     file_source source = file_source{});
 
@@ -488,6 +557,10 @@ public:
     target_count() const noexcept {
         return targets_.size();
     }
+    std::uint64_t
+    alias_count() const noexcept {
+        return aliasCount_;
+    }
     static constexpr std::uint64_t
     max_target_count() noexcept {
         return std::numeric_limits<target_id>::max();
@@ -542,18 +615,57 @@ public:
     {
         querySketcher_.for_each_sketch(queryBegin, queryEnd,
             [this, &res] (const auto& sk) {
-                 res.offsets_.reserve(res.offsets_.size() + sk.size());
-
-                for (auto f : sk) {
-                    auto locs = features_.find(f);
-                    if (locs != features_.end() && locs->size() > 0) {
-                        res.locs_.insert(res.locs_.end(), locs->begin(), locs->end());
-                        res.offsets_.emplace_back(res.locs_.size());
-                    }
-                }
+                accumulate_sketch_matches(sk, res);
             });
     }
 
+    //---------------------------------------------------------------
+    /**
+     * @brief looks up all features of one (query) sketch
+     */
+    void
+    accumulate_sketch_matches(const sketch& sk, matches_sorter& res) const
+    {
+        res.offsets_.reserve(res.offsets_.size() + sk.size());
+
+        for (auto f : sk) {
+            auto locs = features_.find(f);
+            if (locs != features_.end() && locs->size() > 0) {
+                res.locs_.insert(res.locs_.end(), locs->begin(), locs->end());
+                res.offsets_.emplace_back(res.locs_.size());
+            }
+        }
+    }
+
+    //---------------------------------------------------------------
+    /**
+     * @brief looks up the location lists of all features of one (query)
+     *        sketch without copying any locations;
+     *        features without locations are skipped
+     */
+    void
+    find_sketch_locations(const sketch& sk,
+                          std::vector<feature_locations>& out) const
+    {
+        for (auto f : sk) {
+            auto locs = features_.find(f);
+            if (locs != features_.end() && locs->size() > 0) {
+                out.push_back(&(*locs));
+            }
+        }
+    }
+
+    //---------------------------------------------------------------
+    /**
+     * @brief adds one location list (see 'find_sketch_locations')
+     */
+    static void
+    accumulate_locations(feature_locations locs, matches_sorter& res)
+    {
+        res.locs_.insert(res.locs_.end(), locs->begin(), locs->end());
+        res.offsets_.emplace_back(res.locs_.size());
+    }
+
     //---------------------------------------------------------------
     void
     accumulate_matches(const sequence& query,
@@ -570,6 +682,15 @@ public:
         features_.max_load_factor(lf);
     }
     //-----------------------------------------------------
+    /// @brief max. number of threads used for rehashing the feature store
+    void rehash_concurrency(int n) noexcept {
+        features_.rehash_concurrency(n);
+    }
+    //-----------------------------------------------------
+    int rehash_concurrency() const noexcept {
+        return features_.rehash_concurrency();
+    }
+    //-----------------------------------------------------
     float max_load_factor() const noexcept {
         return features_.max_load_factor();
     }
@@ -587,9 +708,13 @@ public:
      */
     void read(const std::string& filename, scope what = scope::sketches);
     /**
-     * @brief   write database to binary file
+     * @brief   write database to binary file;
+     *          the hash table is serialized by 'numThreads' threads
+     *          that write disjoint blocks at precomputed file offsets
+     * @param   sync  flush file to disk (fsync) before returning
      */
-    void write(const std::string& filename) const;
+    void write(const std::string& filename,
+               int numThreads = 1, bool sync = false) const;
 
     //---------------------------------------------------------------
     std::uint64_t bucket_count() const noexcept {
@@ -699,6 +824,31 @@ private:
     }
 
 
+    //---------------------------------------------------------------
+    /// @brief content fingerprint: length + two independent 64 bit hashes
+    struct content_key {
+        std::uint64_t length = 0;
+        std::uint64_t h1 = 0;
+        std::uint64_t h2 = 0;
+
+        friend bool
+        operator == (const content_key& a, const content_key& b) noexcept {
+            return a.length == b.length && a.h1 == b.h1 && a.h2 == b.h2;
+        }
+    };
+
+    struct content_key_hash {
+        std::size_t operator () (const content_key& k) const noexcept {
+            return std::size_t(k.h1 ^ (k.h2 * 0x9e3779b97f4a7c15ull));
+        }
+    };
+
+    static content_key make_content_key(const sequence&);
+
+    bool add_alias(const content_key&, const sequence&,
+                   target_name&, file_source&);
+
+
     //---------------------------------------------------------------
     void make_sketch_inserter() {
         batch_processing_options execOpt;
@@ -724,6 +874,10 @@ private:
     target_store targets_; // target metadata
     std::map<target_name,target_id> name2tax_;
     std::unique_ptr<batch_executor<window_sketch>> inserter_;
+    deduplication dedup_ = deduplication::none;
+    std::uint64_t aliasCount_ = 0;
+    // only used during build; not stored
+    std::unordered_multimap<content_key,target_id,content_key_hash> contents_;
 
 };
 
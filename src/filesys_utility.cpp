@@ -19,10 +19,16 @@
  *
  *****************************************************************************/
 #include <dirent.h> //POSIX header
+#include <fcntl.h>  //POSIX header
+#include <unistd.h> //POSIX header
+#include <cerrno>
 #include <cstring>
 #include <iterator>
+#include <filesystem>
+#include <stdexcept>
 
 #include "filesys_utility.h"
+#include "io_error.h"
 
 
 namespace mc {
@@ -113,6 +119,22 @@ file_size(const std::string& filename)
 
 
 
+//-------------------------------------------------------------------
+void truncate_file(const std::string& filename, std::uintmax_t size)
+{
+    std::error_code ec;
+    if (std::filesystem::file_size(filename, ec) < size || ec) {
+        throw std::runtime_error{"File " + filename + " is too short or "
+                                 "can't be accessed"};
+    }
+    std::filesystem::resize_file(filename, size, ec);
+    if (ec) {
+        throw std::runtime_error{"Could not truncate file " + filename};
+    }
+}
+
+
+
 //-------------------------------------------------------------------
 bool file_readable(const std::string& filename)
 {
@@ -120,5 +142,63 @@ bool file_readable(const std::string& filename)
 }
 
 
+//-------------------------------------------------------------------
+positional_file_writer::positional_file_writer(const std::string& filename):
+    fd_{::open(filename.c_str(), O_WRONLY | O_CREAT, 0644)},
+    filename_{filename}
+{
+    if (fd_ < 0) {
+        throw file_access_error{"can't open file " + filename};
+    }
+}
+
+
+//-------------------------------------------------------------------
+positional_file_writer::~positional_file_writer()
+{
+    if (fd_ >= 0) ::close(fd_);
+}
+
+
+//-------------------------------------------------------------------
+void positional_file_writer::write_at(std::uint64_t offset,
+                                      const void* data, std::size_t size)
+{
+    auto p = static_cast<const char*>(data);
+    while (size > 0) {
+        const auto n = ::pwrite(fd_, p, size, off_t(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw file_write_error{"Could not write to file " + filename_};
+        }
+        p += n;
+        offset += std::uint64_t(n);
+        size -= std::size_t(n);
+    }
+}
+
+
+//-------------------------------------------------------------------
+void positional_file_writer::sync()
+{
+    if (fd_ >= 0 && ::fsync(fd_) != 0) {
+        throw file_write_error{"Could not sync file " + filename_};
+    }
+}
+
+
+//-------------------------------------------------------------------
+void positional_file_writer::close()
+{
+    if (fd_ < 0) return;
+    const auto fd = fd_;
+    fd_ = -1;
+    if (::close(fd) != 0) {
+        throw file_write_error{"Could not close file " + filename_};
+    }
+}
+
+
+
 } // namespace mc
 
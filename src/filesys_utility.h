@@ -23,6 +23,8 @@
 #define RMA_FS_TOOLS_H_
 
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <set>
@@ -72,6 +74,15 @@ std::ifstream::pos_type file_size(const std::string& filename);
 
 
 
+/*************************************************************************//**
+ *
+ * @brief shrinks a file to 'size' bytes; throws if this isn't possible
+ *
+ *****************************************************************************/
+void truncate_file(const std::string& filename, std::uintmax_t size);
+
+
+
 /*************************************************************************//**
  *
  * @return true, if file with name 'filename' could be opened for reading
@@ -80,6 +91,39 @@ std::ifstream::pos_type file_size(const std::string& filename);
 bool file_readable(const std::string& filename);
 
 
+
+/*************************************************************************//**
+ *
+ * @brief writes blocks of data at given file offsets (POSIX 'pwrite');
+ *        'write_at' can be called concurrently from several threads
+ *
+ *****************************************************************************/
+class positional_file_writer
+{
+public:
+    /// @brief opens (and creates) file for writing; doesn't truncate it
+    explicit
+    positional_file_writer(const std::string& filename);
+
+    ~positional_file_writer();
+
+    positional_file_writer(const positional_file_writer&) = delete;
+    positional_file_writer& operator = (const positional_file_writer&) = delete;
+
+    /// @brief throws file_write_error on failure
+    void write_at(std::uint64_t offset, const void* data, std::size_t size);
+
+    /// @brief flushes file data to disk (fsync)
+    void sync();
+
+    void close();
+
+private:
+    int fd_;
+    std::string filename_;
+};
+
+
 } // namespace mc
 
 
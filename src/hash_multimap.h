@@ -29,8 +29,12 @@
 #include <functional>
 #include <atomic>
 #include <mutex>
+#include <thread>
+#include <system_error>
+#include <exception>
 #include <iostream>
 #include <type_traits>
+#include <cstring>
 #include <memory>
 
 #include "chunk_allocator.h"
@@ -517,7 +521,8 @@ public:
         hash_{std::move(src.hash_)},
         keyEqual_{std::move(src.keyEqual_)},
         alloc_{std::move(src.alloc_)},
-        buckets_{std::move(src.buckets_)}
+        buckets_{std::move(src.buckets_)},
+        rehashThreads_{src.rehashThreads_}
     { }
 
 
@@ -539,6 +544,7 @@ public:
         keyEqual_ = std::move(src.keyEqual_);
         alloc_ = std::move(src.alloc_);
         buckets_ = std::move(src.buckets_);
+        rehashThreads_ = src.rehashThreads_;
         return *this;
     }
 
@@ -626,6 +632,11 @@ public:
     /****************************************************************
      * @brief forces a specific number of buckets
      *
+     *        Large tables are rehashed concurrently (see
+     *        'rehash_concurrency'); the resulting bucket layout does not
+     *        depend on the number of threads. More than one thread needs
+     *        a temporary index with one entry per key.
+     *
      * @param n: number of buckets in the hash table
      *
      * @return false, if n is less than the key count or is too small
@@ -635,6 +646,14 @@ public:
     {
         if (!rehash_possible(n)) return false;
 
+        if (numKeys_ >= min_partitioned_rehash_key_count()) {
+            if (rehashThreads_ > 1)
+                rehash_partitioned(n);
+            else
+                rehash_partitioned_serial(n);
+            return true;
+        }
+
         //make temporary new map
         //buckets resize might throw
         hash_multimap newmap{n};
@@ -656,6 +675,20 @@ public:
     }
 
 
+    //---------------------------------------------------------------
+    /// @brief max. number of threads used for rehashing large tables
+    int rehash_concurrency() const noexcept {
+        return rehashThreads_;
+    }
+    void rehash_concurrency(int n) noexcept {
+        rehashThreads_ = n > 1 ? n : 1;
+    }
+
+    static int default_rehash_concurrency() noexcept {
+        return std::max(1, int(std::thread::hardware_concurrency()));
+    }
+
+
     //---------------------------------------------------------------
     iterator
     insert(const key_type& key, const value_type& value)
@@ -926,6 +959,132 @@ public:
     }
 
 
+    //---------------------------------------------------------------
+    /**
+     * @brief same format as 'serialize', but batches are assembled
+     *        concurrently and passed to 'write(offset, data, bytes)' which
+     *        must be thread-safe; offsets are relative to the beginning of
+     *        the serialized table; each batch is written as one block
+     *
+     * @return total number of bytes
+     */
+    template<class BlockWriter>
+    std::uint64_t serialize_concurrently(BlockWriter&& write, int numThreads) const
+    {
+        using len_t = std::uint64_t;
+
+        constexpr len_t numChunks = 256;
+        constexpr len_t keyBytes = sizeof(key_type);
+        constexpr len_t sizeBytes = sizeof(bucket_size_type);
+        constexpr len_t valBytes = sizeof(value_type);
+
+        const len_t bucketCount = buckets_.size();
+        const len_t chunkSize = (bucketCount + numChunks - 1) / numChunks;
+        const len_t batchSize = batch_size();
+
+        //non-empty buckets & values per bucket range
+        std::vector<len_t> chunkKeys(numChunks + 1, 0);
+        std::vector<len_t> chunkVals(numChunks + 1, 0);
+
+        std::atomic<len_t> next{0};
+        run_concurrently(numThreads, [&] {
+            for (auto c = next++; c < numChunks; c = next++) {
+                const auto beg = std::min(bucketCount, c * chunkSize);
+                const auto end = std::min(bucketCount, beg + chunkSize);
+                for (auto i = beg; i < end; ++i) {
+                    const auto& b = buckets_[i];
+                    if (!b.empty()) {
+                        ++chunkKeys[c];
+                        chunkVals[c] += b.size();
+                    }
+                }
+            }
+        });
+
+        //exclusive prefix sums
+        len_t numKeys = 0;
+        len_t numValues = 0;
+        for (len_t c = 0; c <= numChunks; ++c) {
+            const auto k = chunkKeys[c];
+            const auto v = chunkVals[c];
+            chunkKeys[c] = numKeys;
+            chunkVals[c] = numValues;
+            numKeys += k;
+            numValues += v;
+        }
+
+        {
+            const len_t header[3] {numKeys, numValues, batchSize};
+            write(len_t(0), header, sizeof(header));
+        }
+        const len_t headerBytes = 3 * sizeof(len_t);
+
+        //first bucket & value offset of each batch
+        const len_t numBatches = (numKeys + batchSize - 1) / batchSize;
+        std::vector<len_t> batchBucket(numBatches + 1, bucketCount);
+        std::vector<len_t> batchVals(numBatches + 1, numValues);
+
+        next = 0;
+        run_concurrently(numThreads, [&] {
+            for (auto c = next++; c < numChunks; c = next++) {
+                const auto beg = std::min(bucketCount, c * chunkSize);
+                const auto end = std::min(bucketCount, beg + chunkSize);
+                auto rank = chunkKeys[c];
+                auto vals = chunkVals[c];
+                for (auto i = beg; i < end; ++i) {
+                    const auto& b = buckets_[i];
+                    if (!b.empty()) {
+                        if (rank % batchSize == 0) {
+                            batchBucket[rank / batchSize] = i;
+                            batchVals[rank / batchSize] = vals;
+                        }
+                        ++rank;
+                        vals += b.size();
+                    }
+                }
+            }
+        });
+
+        //assemble & write batches: keys, bucket sizes, values
+        next = 0;
+        run_concurrently(numThreads, [&] {
+            std::vector<char> buffer;
+            for (auto bt = next++; bt < numBatches; bt = next++) {
+                const auto nkeys = std::min(batchSize, numKeys - bt * batchSize);
+                const auto nvals = batchVals[bt+1] - batchVals[bt];
+                buffer.resize(nkeys * (keyBytes + sizeBytes) + nvals * valBytes);
+
+                auto keyOut = buffer.data();
+                auto sizeOut = keyOut + nkeys * keyBytes;
+                auto valOut = sizeOut + nkeys * sizeBytes;
+
+                len_t k = 0;
+                for (auto i = batchBucket[bt]; k < nkeys; ++i) {
+                    const auto& b = buckets_[i];
+                    if (b.empty()) continue;
+                    const bucket_size_type size = b.size();
+                    std::memcpy(keyOut, &b.key(), keyBytes);
+                    std::memcpy(sizeOut, &size, sizeBytes);
+                    std::memcpy(valOut, b.begin(), size * valBytes);
+                    keyOut += keyBytes;
+                    sizeOut += sizeBytes;
+                    valOut += size * valBytes;
+                    ++k;
+                }
+
+                const auto offset = headerBytes
+                    + bt * batchSize * (keyBytes + sizeBytes)
+                    + batchVals[bt] * valBytes;
+
+                write(offset, buffer.data(), buffer.size());
+            }
+        });
+
+        return headerBytes + numKeys * (keyBytes + sizeBytes)
+                           + numValues * valBytes;
+    }
+
+
     //---------------------------------------------------------------
     static constexpr size_type default_batch_size() noexcept {
         return size_type(1) << 20;
@@ -1138,6 +1297,257 @@ private:
         return buckets_.end();
     }
 
+    //---------------------------------------------------------------
+    /// @brief tables with fewer keys are rehashed serially
+    static constexpr size_type min_partitioned_rehash_key_count() noexcept {
+        return size_type(1) << 16;
+    }
+
+    //-----------------------------------------------------
+    /// @brief fixed, so that the bucket layout doesn't depend on concurrency
+    static constexpr size_type rehash_partition_count() noexcept {
+        return 256;
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief runs 'job' on up to 'numThreads' threads including the
+     *        calling thread; 'job' must pull its work from a shared counter
+     *        so that all work is done, even if fewer threads could be started;
+     *        the first exception thrown by any job is rethrown
+     */
+    template<class Job>
+    static void run_concurrently(int numThreads, Job&& job)
+    {
+        std::exception_ptr error;
+        std::mutex errorMtx;
+
+        const auto guarded = [&] {
+            try { job(); }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(errorMtx);
+                if (!error) error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        try {
+            for (int i = 1; i < numThreads; ++i) threads.emplace_back(guarded);
+        }
+        catch(std::system_error&) {}
+        guarded();
+        for (auto& t : threads) t.join();
+
+        if (error) std::rethrow_exception(error);
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief two-phase scatter rehash
+     *
+     *  1) old buckets are split into chunks; each chunk counts and then
+     *     scatters its bucket indices into the partition of the new table
+     *     that contains their home slot (order within a partition = old order)
+     *  2) partitions are filled concurrently; keys whose probing sequence
+     *     would leave their partition are deferred
+     *  3) deferred keys are inserted serially (rare for linear probing)
+     *
+     *  Value arrays are not copied, only bucket headers are moved.
+     *  Needs a temporary index with one entry per key on top of the
+     *  new bucket array.
+     *  If anything throws, the old table remains unchanged.
+     */
+    void rehash_partitioned(size_type n)
+    {
+        constexpr size_type numParts = rehash_partition_count();
+        const size_type oldCount = buckets_.size();
+        const size_type partSize = (n + numParts - 1) / numParts;
+        const size_type chunkSize = (oldCount + numParts - 1) / numParts;
+
+        //all allocations happen before anything is moved
+        bucket_store_t newBuckets{buckets_.get_allocator()};
+        newBuckets.resize(n);
+
+        std::vector<size_type> counts(numParts * numParts, 0);
+        std::vector<size_type> order;
+        std::vector<size_type> partBegin(numParts + 1, 0);
+        std::vector<size_type> deferred(numParts, 0);
+
+        const auto home = [&] (const key_type& key) {
+            return size_type(hash_(key) % n);
+        };
+
+        //counts: [chunk][partition] -> offsets: [partition][chunk]
+        std::atomic<size_type> next{0};
+        run_concurrently(rehashThreads_, [&] {
+            for (auto c = next++; c < numParts; c = next++) {
+                const auto beg = std::min(oldCount, c * chunkSize);
+                const auto end = std::min(oldCount, beg + chunkSize);
+                auto cnt = counts.begin() + c * numParts;
+                for (auto i = beg; i < end; ++i) {
+                    const auto& b = buckets_[i];
+                    if (!b.unused()) ++cnt[home(b.key()) / partSize];
+                }
+            }
+        });
+
+        size_type offset = 0;
+        for (size_type p = 0; p < numParts; ++p) {
+            partBegin[p] = offset;
+            for (size_type c = 0; c < numParts; ++c) {
+                auto& cnt = counts[c * numParts + p];
+                const auto k = cnt;
+                cnt = offset;
+                offset += k;
+            }
+        }
+        partBegin[numParts] = offset;
+        order.resize(offset);
+
+        //scatter old bucket indices
+        next = 0;
+        run_concurrently(rehashThreads_, [&] {
+            for (auto c = next++; c < numParts; c = next++) {
+                const auto beg = std::min(oldCount, c * chunkSize);
+                const auto end = std::min(oldCount, beg + chunkSize);
+                auto pos = counts.begin() + c * numParts;
+                for (auto i = beg; i < end; ++i) {
+                    const auto& b = buckets_[i];
+                    if (!b.unused()) order[pos[home(b.key()) / partSize]++] = i;
+                }
+            }
+        });
+
+        //fill partitions; deferred indices are moved to partition front
+        next = 0;
+        run_concurrently(rehashThreads_, [&] {
+            for (auto p = next++; p < numParts; p = next++) {
+                const auto pbeg = p * partSize;
+                const auto pend = std::min(n, pbeg + partSize);
+                auto ndef = partBegin[p];
+
+                for (auto j = partBegin[p]; j < partBegin[p+1]; ++j) {
+                    const auto& b = buckets_[order[j]];
+
+                    probing_iterator it {
+                        newBuckets.begin() + home(b.key()),
+                        newBuckets.begin(), newBuckets.end()};
+
+                    bool placed = false;
+                    do {
+                        const auto s = size_type(iterator(it) - newBuckets.begin());
+                        if (s < pbeg || s >= pend) break;
+                        if (it->unused()) {
+                            *iterator(it) = b;
+                            placed = true;
+                            break;
+                        }
+                    } while (++it);
+
+                    if (!placed) order[ndef++] = order[j];
+                }
+                deferred[p] = ndef - partBegin[p];
+            }
+        });
+
+        //keys are unique => first unused slot in probing sequence
+        for (size_type p = 0; p < numParts; ++p) {
+            const auto beg = partBegin[p];
+            for (auto j = beg; j < beg + deferred[p]; ++j) {
+                const auto& b = buckets_[order[j]];
+                probing_iterator it {
+                    newBuckets.begin() + home(b.key()),
+                    newBuckets.begin(), newBuckets.end()};
+                do {
+                    if (it->unused()) {
+                        *iterator(it) = b;
+                        break;
+                    }
+                } while (++it);
+            }
+        }
+
+        //old buckets don't own their value arrays anymore
+        buckets_ = std::move(newBuckets);
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief single-threaded variant of 'rehash_partitioned' that
+     *        produces the same bucket layout; only the (rare) deferred
+     *        keys are indexed, so no more memory than a plain rehash
+     *        is needed
+     */
+    void rehash_partitioned_serial(size_type n)
+    {
+        constexpr size_type numParts = rehash_partition_count();
+        const size_type partSize = (n + numParts - 1) / numParts;
+
+        bucket_store_t newBuckets{buckets_.get_allocator()};
+        newBuckets.resize(n);
+
+        std::vector<size_type> deferred;
+
+        const auto home = [&] (const key_type& key) {
+            return size_type(hash_(key) % n);
+        };
+
+        //fill partitions in old order; keys whose probing sequence
+        //would leave their partition are deferred
+        for (size_type i = 0; i < buckets_.size(); ++i) {
+            const auto& b = buckets_[i];
+            if (b.unused()) continue;
+
+            const auto h = home(b.key());
+            const auto pbeg = (h / partSize) * partSize;
+            const auto pend = std::min(n, pbeg + partSize);
+
+            probing_iterator it {
+                newBuckets.begin() + h, newBuckets.begin(), newBuckets.end()};
+
+            bool placed = false;
+            do {
+                const auto s = size_type(iterator(it) - newBuckets.begin());
+                if (s < pbeg || s >= pend) break;
+                if (it->unused()) {
+                    *iterator(it) = b;
+                    placed = true;
+                    break;
+                }
+            } while (++it);
+
+            if (!placed) deferred.push_back(i);
+        }
+
+        //same order as in 'rehash_partitioned': by partition, then old order
+        std::stable_sort(deferred.begin(), deferred.end(),
+            [&] (size_type a, size_type b) {
+                return home(buckets_[a].key()) / partSize <
+                       home(buckets_[b].key()) / partSize;
+            });
+
+        //keys are unique => first unused slot in probing sequence
+        for (auto i : deferred) {
+            const auto& b = buckets_[i];
+            probing_iterator it {
+                newBuckets.begin() + home(b.key()),
+                newBuckets.begin(), newBuckets.end()};
+            do {
+                if (it->unused()) {
+                    *iterator(it) = b;
+                    break;
+                }
+            } while (++it);
+        }
+
+        //old buckets don't own their value arrays anymore
+        buckets_ = std::move(newBuckets);
+    }
+
+
     //---------------------------------------------------------------
     void make_sure_enough_buckets_left(size_type more)
     {
@@ -1175,6 +1585,7 @@ private:
     key_equal keyEqual_;
     value_allocator alloc_;
     bucket_store_t buckets_;
+    int rehashThreads_ = default_rehash_concurrency();
 };
 
 
@@ -19,6 +19,7 @@
  *
  *****************************************************************************/
 
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 
@@ -48,19 +49,25 @@ int main(int argc, char** argv)
         else if (modestr == "info") {
             main_mode_info(make_args_list(argv+2, argv+argc));
         }
+        else if (modestr == "convert") {
+            main_mode_convert(make_args_list(argv+2, argv+argc));
+        }
         else {
             main_mode_help(make_args_list(argv, argv+argc));
         }
     }
     catch(std::runtime_error& e) {
         std::cerr << "\nABORT: " << e.what() << '\n';
+        return EXIT_FAILURE;
     }
     catch(std::invalid_argument& e) {
         std::cerr << "ERROR: Invalid command line arguments!\n\n"
                   << e.what() << "\n";
+        return EXIT_FAILURE;
     }
     catch(std::exception& e) {
         std::cerr << e.what() << "\n\n";
+        return EXIT_FAILURE;
     }
 
 }
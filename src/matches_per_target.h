@@ -24,6 +24,7 @@
 #define RMA_MATCHES_PER_TARGET_H_
 
 
+#include <cmath>
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
@@ -32,6 +33,7 @@
 
 #include "candidates.h"
 #include "options.h"
+#include "io_serialize.h"
 
 namespace mc {
 
@@ -439,6 +441,96 @@ private:
 
 };
 
+/*************************************************************************//**
+ *
+ * @brief estimates the coverage of a target by all queries
+ *        from its coverage by a random subsample of the queries
+ *        (assumes Poisson distributed window hits)
+ *
+ *****************************************************************************/
+inline double
+extrapolated_coverage(double coverage, double sampleFraction) noexcept
+{
+    if (sampleFraction >= 1.0 || coverage <= 0.0) return coverage;
+    if (coverage >= 1.0) return 1.0;
+    return 1.0 - std::pow(1.0 - coverage, 1.0 / sampleFraction);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief immutable snapshot of the coverage (covered windows / windows)
+ *        of each target; dense array indexed by target id
+ *        so that coverage lookups don't need any hashing
+ *
+ *****************************************************************************/
+class coverage_per_target
+{
+public:
+    //---------------------------------------------------------------
+    coverage_per_target() = default;
+
+    //---------------------------------------------------------------
+    /**
+     * @param sampleFraction  fraction of queries that contributed to 'mpt'
+     */
+    coverage_per_target(const database& db,
+                        const matches_per_target_light& mpt,
+                        double sampleFraction = 1.0)
+    :
+        coverage_(db.target_count(), 0.0)
+    {
+        for (const auto& mapping : mpt) {
+            const auto tgt = mapping.first;
+            coverage_[tgt] = extrapolated_coverage(
+                double(mapping.second.size()) / db.get_target(tgt).source().windows,
+                sampleFraction);
+        }
+    }
+
+    //---------------------------------------------------------------
+    /**
+     * @brief coverage under classification thresholds 'hitsMin', 'hitsCutoff'
+     */
+    coverage_per_target(const database& db,
+                        const matches_per_target_param& mpt,
+                        std::size_t hitsMin, double hitsCutoff)
+    :
+        coverage_(db.target_count(), 0.0)
+    {
+        for (const auto& mapping : mpt) {
+            const auto tgt = mapping.first;
+            coverage_[tgt] = double(mpt.num_hits(tgt, hitsMin, hitsCutoff))
+                             / db.get_target(tgt).source().windows;
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    double operator [] (target_id tgt) const noexcept {
+        return coverage_[tgt];
+    }
+
+    std::size_t size() const noexcept {
+        return coverage_.size();
+    }
+
+
+    //---------------------------------------------------------------
+    friend void read_binary(std::istream& is, coverage_per_target& c) {
+        read_binary(is, c.coverage_);
+    }
+
+    friend void write_binary(std::ostream& os, const coverage_per_target& c) {
+        write_binary(os, c.coverage_);
+    }
+
+private:
+    std::vector<double> coverage_;
+};
+
+
 } // namespace mc
 
 #endif
@@ -31,6 +31,8 @@
 #include <vector>
 
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <chrono>
 
 #include "timer.h"
@@ -42,6 +44,7 @@
 #include "database.h"
 #include "printing.h"
 #include "sequence_io.h"
+#include "sequence_masking.h"
 
 #include "batch_processing.h"
 
@@ -107,6 +110,176 @@ void add_targets_to_database(
 
 
 
+/*************************************************************************//**
+ *
+ * @brief reads all sequences of a reference file;
+ *        'next()' must return a reference to the next sequence storage
+ *
+ *****************************************************************************/
+template<class Next, class Condition>
+void read_reference_file(const string& filename,
+                         const sequence_masker& mask,
+                         Next&& next, Condition&& proceed,
+                         std::uint64_t& totalLength,
+                         std::uint64_t& maskedLength)
+{
+    auto reader = make_sequence_reader(filename);
+
+    while (reader->has_next() && proceed()) {
+        // get (ref to) next input sequence storage and fill it
+        input_sequence& seq = next();
+        seq.fileSource.filename = filename;
+        seq.fileSource.index = reader->index();
+        reader->next_header_and_data(seq.header, seq.data);
+
+        // masked regions won't be sketched
+        if (mask) {
+            totalLength += seq.data.size();
+            maskedLength += mask(seq.data);
+        }
+    }
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief opens, reads and parses (small) reference files concurrently
+ *
+ *        Files are read ahead by 'numThreads' threads, but at most
+ *        'maxInFlight' files are held in memory. The consumer requests
+ *        files in input order, so the target order is deterministic.
+ *        Files larger than 'maxFileSize' bytes are not read ahead, but
+ *        should be streamed by the consumer.
+ *
+ *****************************************************************************/
+class parallel_file_reader
+{
+public:
+    //---------------------------------------------------------------
+    struct file_contents {
+        input_batch sequences;
+        std::uint64_t totalLength = 0;
+        std::uint64_t maskedLength = 0;
+        // too large to be read ahead
+        bool streamed = false;
+        std::string error;
+    };
+
+
+    //---------------------------------------------------------------
+    parallel_file_reader(const std::vector<string>& files,
+                         const sequence_masker& mask,
+                         int numThreads, std::size_t maxInFlight,
+                         std::uintmax_t maxFileSize)
+    :
+        files_(files), mask_(mask), maxFileSize_{maxFileSize},
+        slots_(std::max(std::size_t(1), maxInFlight))
+    {
+        for (int i = 0; i < numThreads; ++i) {
+            threads_.emplace_back([this] { read_files(); });
+        }
+    }
+
+    //-----------------------------------------------------
+    ~parallel_file_reader() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+
+    //---------------------------------------------------------------
+    /// @brief waits until file #i is read; must be called in file order
+    file_contents& get(std::size_t i) {
+        auto& slot = slots_[i % slots_.size()];
+        std::unique_lock<std::mutex> lock(mtx_);
+        cv_.wait(lock, [&] { return slot.ready; });
+        return slot.contents;
+    }
+
+    //-----------------------------------------------------
+    /// @brief frees memory of file #i so that the next file can be read
+    void release(std::size_t i) {
+        auto& slot = slots_[i % slots_.size()];
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            slot.ready = false;
+            slot.contents = file_contents{};
+            ++released_;
+        }
+        cv_.notify_all();
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    void read_files() {
+        for (;;) {
+            std::size_t i = 0;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [&] {
+                    return stop_ || next_ >= files_.size() ||
+                           next_ < released_ + slots_.size();
+                });
+                if (stop_ || next_ >= files_.size()) return;
+                i = next_++;
+            }
+
+            file_contents contents;
+            try {
+                const auto& filename = files_[i];
+                if (std::uintmax_t(file_size(filename)) > maxFileSize_) {
+                    contents.streamed = true;
+                } else {
+                    read_reference_file(filename, mask_,
+                        [&]() -> input_sequence& {
+                            return contents.sequences.emplace_back();
+                        },
+                        [] { return true; },
+                        contents.totalLength, contents.maskedLength);
+                }
+            }
+            catch(std::exception& e) {
+                contents.sequences.clear();
+                contents.error = e.what();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                auto& slot = slots_[i % slots_.size()];
+                slot.contents = std::move(contents);
+                slot.ready = true;
+            }
+            cv_.notify_all();
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    struct slot {
+        file_contents contents;
+        bool ready = false;
+    };
+
+    const std::vector<string>& files_;
+    const sequence_masker& mask_;
+    std::uintmax_t maxFileSize_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::size_t next_ = 0;
+    std::size_t released_ = 0;
+    bool stop_ = false;
+    std::vector<slot> slots_;
+    std::vector<std::thread> threads_;
+};
+
+
+
 /*************************************************************************//**
  *
  * @brief adds reference sequences from *several* files to database
@@ -114,11 +287,17 @@ void add_targets_to_database(
  *****************************************************************************/
 void add_targets_to_database(database& db,
     const std::vector<string>& infiles,
-    info_level infoLvl = info_level::moderate)
+    const sequence_masker& mask,
+    const build_options& opt)
 {
+    const auto infoLvl = opt.infoLevel;
+
     int n = infiles.size();
     int i = 0;
 
+    std::uint64_t totalLength = 0;
+    std::uint64_t maskedLength = 0;
+
     // make executor that runs database insertion (concurrently) in batches
     // IMPORTANT: do not use more than one worker thread!
     batch_processing_options execOpt;
@@ -148,8 +327,22 @@ void add_targets_to_database(database& db,
             add_targets_to_database(db, batch, infoLvl);
         }};
 
-    // read sequences in main thread
+    // read ahead many small files concurrently
+    std::unique_ptr<parallel_file_reader> readAhead;
+    if (opt.readerThreads > 0 && infiles.size() > 1) {
+        readAhead = std::make_unique<parallel_file_reader>(
+            infiles, mask, opt.readerThreads,
+            4 * std::size_t(opt.readerThreads),
+            std::uintmax_t(opt.maxReadAheadFileSize) << 20);
+    }
+
+    const auto next  = [&]() -> input_sequence& { return executor.next_item(); };
+    const auto valid = [&] { return executor.valid(); };
+
+    // feed sequences in file order from main thread
     for (const auto& filename : infiles) {
+        if (!executor.valid()) break;
+
         if (infoLvl == info_level::verbose) {
             cout << "  " << filename << " ... " << flush;
         } else if (infoLvl != info_level::silent) {
@@ -157,17 +350,29 @@ void add_targets_to_database(database& db,
         }
 
         try {
-            const auto fileId = extract_accession_string(
-                                    filename, sequence_id_type::acc_ver);
-
-            auto reader = make_sequence_reader(filename);
-
-            while (reader->has_next() && executor.valid()) {
-                // get (ref to) next input sequence storage and fill it
-                auto& seq = executor.next_item();
-                seq.fileSource.filename = filename;
-                seq.fileSource.index = reader->index();
-                reader->next_header_and_data(seq.header, seq.data);
+            if (readAhead) {
+                auto& file = readAhead->get(i);
+                if (!file.error.empty()) {
+                    const auto msg = std::move(file.error);
+                    readAhead->release(i);
+                    throw std::runtime_error{msg};
+                }
+                if (file.streamed) {
+                    readAhead->release(i);
+                    read_reference_file(filename, mask, next, valid,
+                                        totalLength, maskedLength);
+                } else {
+                    for (auto& seq : file.sequences) {
+                        if (!executor.valid()) break;
+                        next() = std::move(seq);
+                    }
+                    totalLength += file.totalLength;
+                    maskedLength += file.maskedLength;
+                    readAhead->release(i);
+                }
+            } else {
+                read_reference_file(filename, mask, next, valid,
+                                    totalLength, maskedLength);
             }
 
             if (infoLvl == info_level::verbose) {
@@ -181,6 +386,13 @@ void add_targets_to_database(database& db,
         }
         ++i;
     }
+
+    if (mask && totalLength > 0 && infoLvl != info_level::silent) {
+        clear_current_line(cout);
+        cout << "Masked " << maskedLength << " of " << totalLength
+             << " nucleotides (" << (100.0 * maskedLength / totalLength)
+             << "%)" << endl;
+    }
 }
 
 
@@ -192,6 +404,8 @@ void add_targets_to_database(database& db,
  *****************************************************************************/
 void prepare_database(database& db, const build_options& opt)
 {
+    db.rehash_concurrency(opt.rehashThreads);
+
     const auto dbconf = opt.dbconfig;
     if (dbconf.maxLocationsPerFeature > 0) {
         db.max_locations_per_feature(dbconf.maxLocationsPerFeature);
@@ -210,6 +424,10 @@ void prepare_database(database& db, const build_options& opt)
     {
         cerr << "Ambiguous features will be removed afterwards.\n";
     }
+
+    if (opt.dedup.identical) {
+        db.target_deduplication(database::deduplication::identical);
+    }
 }
 
 
@@ -278,16 +496,23 @@ void add_to_database(database& db, const build_options& opt)
 
     if (!opt.infiles.empty()) {
         const auto initNumTargets = db.target_count();
+        const auto initNumAliases = db.alias_count();
 
         if (notSilent) cout << "Processing reference sequences." << endl;
 
-        add_targets_to_database(db, opt.infiles, opt.infoLevel);
+        const sequence_masker mask{opt.masking};
+
+        add_targets_to_database(db, opt.infiles, mask, opt);
 
         if (notSilent) {
             clear_current_line(cout);
             cout << "Added "
-                 << (db.target_count() - initNumTargets) << " reference sequences "
-                 << "in " << time.seconds() << " s" << endl;
+                 << (db.target_count() - initNumTargets) << " reference sequences ";
+            if (db.alias_count() > initNumAliases) {
+                cout << "(+ " << (db.alias_count() - initNumAliases)
+                     << " identical sequences as aliases) ";
+            }
+            cout << "in " << time.seconds() << " s" << endl;
 
             print_content_properties(db);
         }
@@ -299,10 +524,10 @@ void add_to_database(database& db, const build_options& opt)
         cout << "Writing database to file '" << opt.dbfile << "' ... " << flush;
     }
     try {
-        db.write(opt.dbfile);
+        db.write(opt.dbfile, opt.writerThreads, opt.syncOnWrite);
         if (notSilent) cout << "done." << endl;
     }
-    catch(const file_access_error&) {
+    catch(const file_io_error&) {
         if (notSilent) cout << "FAIL" << endl;
         cerr << "Could not write database file!\n";
     }
@@ -0,0 +1,96 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "options.h"
+#include "binary_mappings.h"
+#include "io_error.h"
+
+
+namespace mc {
+
+using std::cout;
+using std::cerr;
+using std::string;
+
+
+/*************************************************************************//**
+ *
+ * @brief writes all records of a binary mapping file as mapping table
+ *
+ *****************************************************************************/
+void convert_binary_mappings(const convert_options& opt, std::ostream& os)
+{
+    binary_mapping_reader reader {opt.infile};
+
+    const auto& fmt = opt.format;
+    const auto& colsep = fmt.tokens.column;
+
+    // same layout as default mapping table
+    os << fmt.tokens.comment << "TABLE_LAYOUT: ";
+    if (fmt.showQueryIds) os << "query_id" << colsep;
+    os << (reader.has_headers() ? "query_header" : "query_id") << colsep
+       << "top_hits" << colsep;
+    if (opt.showLocations) os << "candidate_locations" << colsep;
+    os << '\n';
+
+    mapping_record rec;
+    std::size_t count = 0;
+    while (reader.next(rec)) {
+        show_mapping_record(os, reader, fmt, opt.showLocations, rec);
+        ++count;
+    }
+
+    os << fmt.tokens.comment << "queries: " << count << '\n';
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief binary mapping file -> text mapping table
+ *
+ *****************************************************************************/
+void main_mode_convert(const cmdline_args& args)
+{
+    auto opt = get_convert_options(args);
+
+    if (opt.outfile.empty()) {
+        convert_binary_mappings(opt, cout);
+        return;
+    }
+
+    std::ofstream os {opt.outfile};
+    if (!os.good()) {
+        throw file_write_error{"Could not write to file " + opt.outfile};
+    }
+    convert_binary_mappings(opt, os);
+
+    if (!os.good()) {
+        throw file_write_error{"Could not write to file " + opt.outfile};
+    }
+}
+
+
+} // namespace mc
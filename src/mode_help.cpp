@@ -56,6 +56,7 @@ void main_mode_help(const cmdline_args& args)
             "\n"
             "    build       build new database from reference sequence(s)\n"
             "    query       map reads using pre-built database\n"
+            "    convert     convert binary mapping output to text\n"
             "    help        shows documentation \n"
             "\n"
             "\n"
@@ -92,6 +93,9 @@ void main_mode_help(const cmdline_args& args)
     else if (args[2] == "info") {
         std::cout << info_mode_docs() << '\n';
     }
+    else if (args[2] == "convert") {
+        std::cout << convert_mode_docs() << '\n';
+    }
     else {
         std::cerr
             << "You need to specify a mode for which to show help :\n"
@@ -128,6 +128,10 @@ void show_target_info(std::ostream& os, const database& db, target_id tgt)
         << "\n    length:     " << meta.source().windows << " windows"
         << "\n    (ID) Name:  " << "(" << tgt << ") " << meta.name()
         << '\n';
+
+    for (const auto& a : meta.aliases()) {
+        os  << "    alias:      " << a.name << "  " << a.source.filename << " / " << a.source.index << '\n';
+    }
 }
 
 
@@ -21,16 +21,26 @@
  *****************************************************************************/
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "options.h"
+#include "batch_processing.h"
+#include "bgzf_stream.h"
 #include "cmdline_utility.h"
 #include "filesys_utility.h"
 #include "classification.h"
 #include "classify_common.h"
+#include "query_checkpoint.h"
 #include "classification_statistics.h"
 #include "printing.h"
 #include "config.h"
@@ -49,67 +59,515 @@ using std::flush;
 
 /*************************************************************************//**
  *
- * @brief runs classification on input files; sets output target streams
+ * @brief database names used in output filenames and table columns
+ *        (database filenames without directory and extension)
+ *
+ *****************************************************************************/
+vector<string> database_names(const query_options& opt)
+{
+    vector<string> names;
+
+    const auto add = [&] (const string& filename) {
+        auto name = extract_filename(filename);
+        const auto dot = name.find_last_of('.');
+        if (dot != string::npos && dot > 0) name.erase(dot);
+        // keep names unique
+        if (std::find(names.begin(), names.end(), name) != names.end()) {
+            name += "_" + std::to_string(names.size());
+        }
+        names.push_back(std::move(name));
+    };
+
+    add(opt.dbfile);
+    for (const auto& f : opt.additionalDbfiles) add(f);
+
+    return names;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief inserts name before file extension
+ *        ('res.txt', 'lambda' -> 'res_lambda.txt')
+ *
+ *****************************************************************************/
+string derived_output_filename(const string& filename, const string& name)
+{
+    const auto slash = filename.find_last_of("/\\");
+    const auto dot = filename.find_last_of('.');
+
+    if (dot == string::npos || dot == 0 ||
+        (slash != string::npos && dot <= slash + 1))
+    {
+        return filename + "_" + name;
+    }
+    return filename.substr(0, dot) + "_" + name + filename.substr(dot);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief output files are compressed if requested or if named '*.gz'
+ *
+ *****************************************************************************/
+bool compressed_output(const query_options& opt, const string& filename)
+{
+    const bool gz = filename.size() > 3 &&
+                    filename.compare(filename.size() - 3, 3, ".gz") == 0;
+    #ifdef RMA_BAM
+    return gz || opt.output.compressFiles;
+    #else
+    (void)opt;
+    return gz;
+    #endif
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief runs classification on input files; sets output target streams;
+ *        output for additional databases goes to separate files
+ *        unless a combined mapping table is requested;
+ *        status messages are written to 'log'
  *
  *****************************************************************************/
 void process_input_files(const vector<string>& infiles,
-                         const database& db, const query_options& opt,
+                         const vector<const database*>& dbs,
+                         const vector<string>& dbNames,
+                         const query_options& initOpt,
                          const string& queryMappingsFilename,
-                         const string& samFilename)
+                         const string& samFilename,
+                         std::ostream& log)
 {
-    std::ostream* mainOut   = &cout;
-    std::ostream* samOut    = &cout;
+    auto opt = initOpt;
+    const bool multi = dbs.size() > 1;
+
+    if (multi && queryMappingsFilename.empty()) {
+        if (opt.output.samMode != sam_mode::none && samFilename.empty()) {
+            throw std::runtime_error{
+                "SAM/BAM output for multiple databases requires an "
+                "output filename ('-out' or '-with-sam-out')!"};
+        }
+        // several tables can't be written to stdout
+        opt.output.combineDatabases = true;
+    }
+    const bool combined = multi && opt.output.combineDatabases;
 
-    std::ofstream mapFile;
-    if (!queryMappingsFilename.empty()) {
-        mapFile.open(queryMappingsFilename, std::ios::out);
+    const auto& checkpointFile = opt.checkpoint.filename;
+    query_checkpoint checkpoint;
+
+    if (!checkpointFile.empty()) {
+        if (queryMappingsFilename.empty()) {
+            throw std::runtime_error{
+                "Checkpoints require mapping output to a file ('-out')!"};
+        }
+        #ifdef RMA_BAM
+        if (htslib_output(opt.output.samMode)) {
+            throw std::runtime_error{"Checkpoints are not available for BAM/CRAM output!"};
+        }
+        #endif
+        if (!opt.binaryMappingsFile.empty()) {
+            throw std::runtime_error{
+                "Checkpoints are not available for binary mapping output!"};
+        }
+        if (compressed_output(opt, queryMappingsFilename) ||
+            (!samFilename.empty() && compressed_output(opt, samFilename)))
+        {
+            throw std::runtime_error{
+                "Checkpoints are not available for compressed output!"};
+        }
+        // counts are only kept in memory
+        if (!opt.conversionTableFile.empty()) {
+            throw std::runtime_error{
+                "Checkpoints are not available with conversion tables!"};
+        }
+    }
+    else if (opt.checkpoint.resume) {
+        throw std::runtime_error{
+            "'-resume' requires a checkpoint file ('-checkpoint <file>')!"};
+    }
+
+    // only resume if there is a consistent state to resume from
+    if (opt.checkpoint.resume) {
+        opt.checkpoint.resume = read_query_checkpoint(checkpointFile, checkpoint);
+        if (!opt.checkpoint.resume) {
+            log << "No checkpoint found - processing all input.\n";
+        }
+        else if (checkpoint.outputs.size() != dbs.size()) {
+            throw std::runtime_error{"Checkpoint " + checkpointFile +
+                " doesn't match the input files and databases!"};
+        }
+        else {
+            log << "Resuming from checkpoint " << checkpointFile << '\n';
+        }
+    }
+
+    // deques: references to elements stay valid
+    std::deque<std::ofstream> files;
+    #ifdef RMA_BAM
+    std::deque<bgzf_ostream> gzFiles;
+    #endif
+    std::deque<classification_results> results;
+
+    const auto openFile = [&] (const string& filename,
+                               std::uint64_t resumeSize) -> std::ostream&
+    {
+        if (compressed_output(opt, filename)) {
+            #ifdef RMA_BAM
+            gzFiles.emplace_back(filename, opt.performance.bamThreads);
+            return gzFiles.back();
+            #else
+            throw std::runtime_error{"Compressed output ('" + filename +
+                                     "') requires a build with RMA_BAM=TRUE!"};
+            #endif
+        }
+        if (opt.checkpoint.resume) {
+            // discard everything written after the last checkpoint
+            truncate_file(filename, resumeSize);
+            files.emplace_back(filename, std::ios::in | std::ios::out);
+            files.back().seekp(0, std::ios::end);
+        }
+        else {
+            files.emplace_back(filename, std::ios::out);
+        }
+        if (!files.back().good()) {
+            throw file_write_error{"Could not write to file " + filename};
+        }
+        return files.back();
+    };
+
+    for (size_t i = 0; i < dbs.size(); ++i) {
+        const auto dbFilename = [&] (const string& filename) {
+            return i == 0 ? filename : derived_output_filename(filename, dbNames[i]);
+        };
+
+        std::ostream* mainOut   = &cout;
+        std::ostream* samOut    = &cout;
+
+        const auto resumeSize = opt.checkpoint.resume
+                              ? checkpoint.outputs[i] : query_output_positions{};
+
+        if (combined && i > 0) {
+            mainOut = &results.front().mainOut;
+        }
+        else if (!queryMappingsFilename.empty()) {
+            const auto filename = dbFilename(queryMappingsFilename);
+            mainOut = &openFile(filename, resumeSize.mainOut);
 
-        if (mapFile.good()) {
             if (opt.output.samMode == sam_mode::sam && samFilename.empty())
-                cerr << "SAM will be written to file: " << queryMappingsFilename << '\n';
+                log << "SAM will be written to file: " << filename << '\n';
+            else
+                log << "Per-Read mappings will be written to file:" << filename << '\n';
+        }
+
+        if (!samFilename.empty()) {
+            const auto filename = dbFilename(samFilename);
+            #ifdef RMA_BAM
+            if (htslib_output(opt.output.samMode))
+                samOut = mainOut;   // BAM/CRAM file is opened by htslib
             else
-                cerr << "Per-Read mappings will be written to file:" << queryMappingsFilename << '\n';
-            
-            mainOut = &mapFile;
+            #endif
+                samOut = &openFile(filename, resumeSize.samOut);
+            log << "SAM/BAM/CRAM will be written to file: " << filename << '\n';
+        }
+        else if (combined && i > 0 && opt.output.samMode != sam_mode::none) {
+            // SAM output is never combined
+            const auto filename = dbFilename(queryMappingsFilename);
+            samOut = &openFile(filename, resumeSize.samOut);
+            log << "SAM will be written to file: " << filename << '\n';
         }
         else {
-            throw file_write_error{"Could not write to file " + queryMappingsFilename};
+            samOut = mainOut;
+        }
+
+        results.emplace_back(*mainOut, *samOut);
+
+        if (!opt.conversionTableFile.empty()) {
+            results.back().conversionTableFile = dbFilename(opt.conversionTableFile);
+        }
+
+        if (!opt.binaryMappingsFile.empty()) {
+            const auto filename = dbFilename(opt.binaryMappingsFile);
+            results.back().binaryOut = std::make_unique<binary_mapping_writer>(
+                filename, *dbs[i], opt.output.binaryHeaders);
+            log << "Binary mappings will be written to file: " << filename << '\n';
         }
+
+        #ifdef RMA_BAM
+        results.back().bamFilename = dbFilename(samFilename);
+        #endif
     }
 
-    std::ofstream samFile;
-    if (!samFilename.empty()) {
-        samFile.open(samFilename, std::ios::out);
+    vector<classification_results*> resultPtrs;
+    for (auto& res : results) resultPtrs.push_back(&res);
+
+    const auto& comment = opt.output.format.tokens.comment;
 
-        if (samFile.good()) {
-            cerr << "SAM/BAM will be written to file: " << samFilename << '\n';
-            samOut = &samFile;
+    // a resumed run appends to existing output
+    if (opt.output.showQueryParams && !opt.checkpoint.resume) {
+        for (size_t i = 0; i < dbs.size(); ++i) {
+            if (multi) results[i].mainOut << comment << "database: " << dbNames[i] << '\n';
+            show_query_parameters(results[i].mainOut, *dbs[i], opt);
         }
-        else {
-            throw file_write_error{"Could not write to file " + samFilename};
+    }
+
+    for (auto& res : results) {
+        res.flush_all_streams();
+        res.time.start();
+    }
+
+    map_queries_to_targets(infiles, dbs, dbNames, opt, resultPtrs);
+
+    for (auto& res : results) res.time.stop();
+
+    if (opt.output.showProgress) {
+        clear_current_line(cerr);
+        cerr.flush();
+    }
+
+    for (auto& res : results) {
+        if (res.binaryOut) res.binaryOut->close();
+    }
+
+    for (size_t i = 0; i < dbs.size(); ++i) {
+        const auto& res = results[i];
+        if (!res.conversionTableFile.empty()) {
+            write_conversion_table(res.conversionTableFile, *dbs[i], res.conversions);
+            log << "Conversion counts of " << res.conversions.size()
+                 << " positions written to file: " << res.conversionTableFile << '\n';
+        }
+    }
+
+    for (size_t i = 0; i < dbs.size(); ++i) {
+        if (multi && (opt.output.showSummary || opt.sweep.active())) {
+            results[i].mainOut << comment << "database: " << dbNames[i] << '\n';
+        }
+        if (opt.output.showSummary) show_summary(opt, results[i]);
+        show_sweep_results(opt, results[i]);
+    }
+
+    for (auto& res : results) res.flush_all_streams();
+
+    #ifdef RMA_BAM
+    // write remaining blocks + EOF marker
+    for (auto& f : gzFiles) f.close();
+    #endif
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief input file(s) that are mapped into one set of output files
+ *
+ *****************************************************************************/
+struct query_sample
+{
+    string name;
+    vector<string> files;
+    pairing_mode pairing = pairing_mode::none;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief sample name = filename without directory and extension(s);
+ *        for file pairs: common prefix without trailing '_R', '_', '.', '-'
+ *
+ *****************************************************************************/
+string sample_name(const vector<string>& files)
+{
+    const auto stem = [] (const string& filename) {
+        auto name = extract_filename(filename);
+        for (const char* ext : {".gz", ".fastq", ".fq", ".fasta", ".fa", ".fna"}) {
+            const auto n = std::char_traits<char>::length(ext);
+            if (name.size() > n && name.compare(name.size() - n, n, ext) == 0) {
+                name.erase(name.size() - n);
+            }
+        }
+        const auto dot = name.find_last_of('.');
+        if (dot != string::npos && dot > 0) name.erase(dot);
+        return name;
+    };
+
+    if (files.empty()) return "";
+
+    auto name = stem(files.front());
+
+    if (files.size() > 1) {
+        const auto other = stem(files[1]);
+        const auto mis = std::mismatch(name.begin(), name.end(),
+                                       other.begin(), other.end());
+        string prefix {name.begin(), mis.first};
+
+        while (!prefix.empty() &&
+               (prefix.back() == '_' || prefix.back() == '.' || prefix.back() == '-'))
+        {
+            prefix.pop_back();
+        }
+        if (prefix.size() > 2 &&
+            prefix.compare(prefix.size() - 2, 2, "_R") == 0)
+        {
+            prefix.erase(prefix.size() - 2);
         }
-    } else {
-        samOut = mainOut;
+        if (!prefix.empty()) name = std::move(prefix);
     }
+    return name;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief groups input files into samples
+ *        (consecutive file pairs if pairing mode is 'files')
+ *
+ *****************************************************************************/
+vector<query_sample> query_samples(const query_options& opt)
+{
+    vector<query_sample> samples;
 
-    classification_results results {*mainOut,*samOut};
+    const auto& infiles = opt.infiles;
+    const size_t step = opt.pairing == pairing_mode::files ? 2 : 1;
 
-    if (opt.output.showQueryParams) {
-        show_query_parameters(results.mainOut, db, opt);
+    for (size_t i = 0; i < infiles.size(); i += step) {
+        query_sample s;
+        if (i + step <= infiles.size()) {
+            s.files.assign(infiles.begin() + i, infiles.begin() + i + step);
+            s.pairing = opt.pairing;
+        } else {
+            // unpaired leftover file
+            s.files.push_back(infiles[i]);
+        }
+        s.name = sample_name(s.files);
+
+        // keep names unique
+        const auto sameName = [&] (const query_sample& x) { return x.name == s.name; };
+        if (std::any_of(samples.begin(), samples.end(), sameName)) {
+            s.name += "_" + std::to_string(samples.size());
+        }
+        samples.push_back(std::move(s));
     }
+    return samples;
+}
 
-    results.flush_all_streams();
 
-    results.time.start();
-    map_queries_to_targets(infiles, db, opt, results);
-    results.time.stop();
 
-    clear_current_line(cerr);
-    cerr.flush();
+/*************************************************************************//**
+ *
+ * @brief output filename for one sample
+ *        ('{sample}' placeholder is replaced, otherwise name is inserted
+ *        before the file extension)
+ *
+ *****************************************************************************/
+string sample_output_filename(const string& filenameTemplate,
+                              const string& sampleName)
+{
+    static const string placeholder = "{sample}";
 
-    if (opt.output.showSummary) show_summary(opt, results);
+    const auto pos = filenameTemplate.find(placeholder);
+    if (pos == string::npos) {
+        return derived_output_filename(filenameTemplate, sampleName);
+    }
+    auto filename = filenameTemplate;
+    filename.replace(pos, placeholder.size(), sampleName);
+    return filename;
+}
 
-    results.flush_all_streams();
+
+
+/*************************************************************************//**
+ *
+ * @brief runs classification separately for each input file (or file pair);
+ *        several samples are processed concurrently; all of them share
+ *        the available threads: workers (and sample threads) that become
+ *        free are taken over by the samples that are still running;
+ *        each sample writes to its own files
+ *
+ *****************************************************************************/
+void process_samples_separately(const vector<const database*>& dbs,
+                                const query_options& opt)
+{
+    const auto samples = query_samples(opt);
+    const auto dbNames = database_names(opt);
+
+    string mapTemplate = opt.queryMappingsFile;
+    if (mapTemplate.empty()) {
+        mapTemplate = opt.output.samMode == sam_mode::sam && opt.samFile.empty()
+                    ? "{sample}.sam" : "{sample}.txt";
+    }
+
+    const int numThreads = std::max(1, opt.performance.numThreads);
+    const int concurrent = std::max(1, std::min(int(samples.size()), numThreads));
+
+    // one thread per running sample reads its input; all others are workers
+    thread_budget sharedThreads {numThreads - concurrent, numThreads - 1};
+
+    auto sampleOpt = opt;
+    sampleOpt.splitOutputPerInput = false;
+    // initial share of threads; grows as other samples finish
+    sampleOpt.performance.numThreads = numThreads / concurrent;
+    sampleOpt.performance.sharedThreads = &sharedThreads;
+    // progress indicators of concurrent samples would overwrite each other
+    if (concurrent > 1) sampleOpt.output.showProgress = false;
+
+    std::atomic<size_t> next {0};
+    std::atomic<size_t> failed {0};
+    std::mutex logMtx;
+
+    const auto process = [&] {
+        for (size_t i = next++; i < samples.size(); i = next++) {
+            const auto& sample = samples[i];
+
+            auto o = sampleOpt;
+            o.infiles = sample.files;
+            o.pairing = sample.pairing;
+            if (!opt.checkpoint.filename.empty()) {
+                o.checkpoint.filename =
+                    sample_output_filename(opt.checkpoint.filename, sample.name);
+            }
+            if (!opt.conversionTableFile.empty()) {
+                o.conversionTableFile =
+                    sample_output_filename(opt.conversionTableFile, sample.name);
+            }
+            if (!opt.binaryMappingsFile.empty()) {
+                o.binaryMappingsFile =
+                    sample_output_filename(opt.binaryMappingsFile, sample.name);
+            }
+
+            const auto samName = opt.samFile.empty() ? string{}
+                               : sample_output_filename(opt.samFile, sample.name);
+
+            // status messages of a sample are written in one piece
+            std::ostringstream log;
+            try {
+                process_input_files(o.infiles, dbs, dbNames, o,
+                    sample_output_filename(mapTemplate, sample.name), samName, log);
+            }
+            catch (std::exception& e) {
+                ++failed;
+                log << "FAIL: sample " << sample.name << ": " << e.what() << '\n';
+            }
+            std::lock_guard<std::mutex> lock(logMtx);
+            cerr << log.str() << flush;
+        }
+        // no samples left => thread can be taken over by running samples
+        sharedThreads.release();
+    };
+
+    vector<std::thread> threads;
+    for (int i = 1; i < concurrent; ++i) threads.emplace_back(process);
+    process();
+    for (auto& t : threads) t.join();
+
+    if (failed > 0) {
+        throw std::runtime_error{std::to_string(failed) + " of " +
+            std::to_string(samples.size()) + " samples failed"};
+    }
 }
 
 
@@ -120,7 +578,7 @@ void process_input_files(const vector<string>& infiles,
  *        handles output file split
  *
  *****************************************************************************/
-void process_input_files(const database& db,
+void process_input_files(const vector<const database*>& dbs,
                          const query_options& opt)
 {
     const auto& infiles = opt.infiles;
@@ -139,31 +597,14 @@ void process_input_files(const database& db,
         }
     }
 
-    process_input_files(infiles, db, opt, opt.queryMappingsFile, opt.samFile);
-
-}
-
+    if (opt.splitOutputPerInput) {
+        process_samples_separately(dbs, opt);
+        return;
+    }
 
+    process_input_files(infiles, dbs, database_names(opt), opt,
+                        opt.queryMappingsFile, opt.samFile, cerr);
 
-/*************************************************************************//**
- *
- * @brief sets up some query options according to database parameters
- *        or command line options
- *
- *****************************************************************************/
-void adapt_options_to_database(classification_options& opt, const database& db)
-{
-    //deduce hit threshold from database?
-    if (opt.hitsMin < 1) {
-        auto sks = db.target_sketcher().sketch_size();
-        if (sks >= 6) {
-            opt.hitsMin = static_cast<int>(sks / 3.0);
-        } else if (sks >= 4) {
-            opt.hitsMin = 2;
-        } else {
-            opt.hitsMin = 1;
-        }
-    }
 }
 
 
@@ -173,7 +614,7 @@ void adapt_options_to_database(classification_options& opt, const database& db)
  * @brief primitive REPL mode for repeated querying using the same database
  *
  *****************************************************************************/
-void run_interactive_query_mode(const database& db,
+void run_interactive_query_mode(const vector<const database*>& dbs,
                                 const query_options& initOpt)
 {
     while (true) {
@@ -198,8 +639,10 @@ void run_interactive_query_mode(const database& db,
             //read command line options (use initial ones as defaults)
             try {
                 auto opt = get_query_options(args, initOpt);
-                adapt_options_to_database(opt.classify, db);
-                process_input_files(db, opt);
+                // databases can't be changed
+                opt.additionalDbfiles = initOpt.additionalDbfiles;
+                adapt_options_to_database(opt.classify, *dbs.front());
+                process_input_files(dbs, opt);
             }
             catch(std::exception& e) {
                 if (initOpt.output.showErrors) cerr << e.what() << '\n';
@@ -210,6 +653,23 @@ void run_interactive_query_mode(const database& db,
 
 
 
+/*************************************************************************//**
+ *
+ * @return true, if both databases produce comparable hit counts
+ *
+ *****************************************************************************/
+bool same_sketching(const database& a, const database& b)
+{
+    const auto& x = a.target_sketcher();
+    const auto& y = b.target_sketcher();
+    return x.kmer_size()     == y.kmer_size() &&
+           x.sketch_size()   == y.sketch_size() &&
+           x.window_size()   == y.window_size() &&
+           x.window_stride() == y.window_stride();
+}
+
+
+
 /*************************************************************************//**
  *
  * @brief read database and modify db content and sketching scheme according to
@@ -305,13 +765,29 @@ void main_mode_query(const cmdline_args& args)
 {
     auto opt = get_query_options(args);
 
-    auto db = read_database(opt.dbfile, opt.dbconfig, opt.sketching);
+    // all databases are queried with the same reads
+    vector<database> dbs;
+    dbs.reserve(1 + opt.additionalDbfiles.size());
+    dbs.push_back(read_database(opt.dbfile, opt.dbconfig, opt.sketching));
+    for (const auto& dbfile : opt.additionalDbfiles) {
+        dbs.push_back(read_database(dbfile, opt.dbconfig, opt.sketching));
+        // hit thresholds are deduced from / refer to the first database
+        if (!same_sketching(dbs.front(), dbs.back())) {
+            throw std::runtime_error{"Database " + dbfile + " was built with "
+                "different sketching parameters (k-mer length, sketch size, "
+                "window length or stride) than " + opt.dbfile + "!"};
+        }
+    }
+
+    vector<const database*> dbPtrs;
+    for (const auto& db : dbs) dbPtrs.push_back(&db);
 
     if (!opt.infiles.empty()) {
         cerr << "Classifying query sequences.\n";
 
-        adapt_options_to_database(opt.classify, db);
-        process_input_files(db, opt);
+        // hit threshold is deduced from the first database
+        adapt_options_to_database(opt.classify, dbs.front());
+        process_input_files(dbPtrs, opt);
     }
     else {
         cout << "No input files provided.\n"
@@ -324,7 +800,7 @@ void main_mode_query(const cmdline_args& args)
             " - Enter an empty line or press Ctrl-D to quit RmapAlign3N.\n"
             << endl;
 
-        run_interactive_query_mode(db, opt);
+        run_interactive_query_mode(dbPtrs, opt);
     }
 }
 
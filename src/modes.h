@@ -56,6 +56,15 @@ void main_mode_info(const cmdline_args&);
 
 
 
+/*************************************************************************//**
+ *
+ * @brief converts binary mapping output into text mapping tables
+ *
+ *****************************************************************************/
+void main_mode_convert(const cmdline_args&);
+
+
+
 /*************************************************************************//**
  *
  * @brief help
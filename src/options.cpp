@@ -32,6 +32,7 @@
  *****************************************************************************/
 
 #include <stdexcept>
+#include <sstream>
 #include <algorithm>
 #include <regex>
 
@@ -354,6 +355,69 @@ database_storage_options_cli(database_storage_options& opt, error_messages& err)
 
 
 
+//-------------------------------------------------------------------
+/// @brief build mode command-line options for low-complexity masking
+clipp::group
+masking_options_cli(masking_options& opt, error_messages& err)
+{
+    using namespace clipp;
+
+    return (
+    (
+        option("-dust").set(opt.dust)
+        %("Masks low-complexity regions (DUST) in reference sequences. "
+          "Masked regions don't produce features, which reduces build "
+          "time, memory consumption and overpopulated features.\n"
+          "default: "s + (opt.dust ? "on" : "off"))
+    )
+    ,
+    (   option("-dust-level").set(opt.dust) &
+        integer("#", opt.dustLevel)
+            .if_missing([&]{ err += "Number missing after '-dust-level'!"; })
+    )
+        %("DUST score threshold (implies '-dust'); "
+          "smaller values mask more.\n"
+          "default: "s + to_string(opt.dustLevel))
+    ,
+    (   option("-dust-window").set(opt.dust) &
+        integer("#", opt.dustWindow)
+            .if_missing([&]{ err += "Number missing after '-dust-window'!"; })
+    )
+        %("DUST window length (implies '-dust')\n"
+          "default: "s + to_string(opt.dustWindow))
+    ,
+    (
+        option("-soft-masked").set(opt.softMasked)
+        %("Masks lower case nucleotides (soft-masked references).\n"
+          "default: "s + (opt.softMasked ? "on" : "off"))
+    )
+    );
+}
+
+
+
+//-------------------------------------------------------------------
+/// @brief build mode command-line options for target deduplication
+clipp::group
+deduplication_options_cli(deduplication_options& opt, error_messages&)
+{
+    using namespace clipp;
+
+    return group(
+        option("-dedup").set(opt.identical)
+        %("Stores reference sequences with identical content as aliases "
+          "of the first sequence with that content. Aliases are not "
+          "sketched, which reduces build time and database size for "
+          "redundant reference collections. Mappings are reported for "
+          "the first sequence (see query option '-show-aliases'). "
+          "Only sequences added in the same run are compared; their "
+          "sequences are kept in memory until the build is finished.\n"
+          "default: "s + (opt.identical ? "on" : "off"))
+    );
+}
+
+
+
 /*****************************************************************************
  *
  *
@@ -387,9 +451,55 @@ build_mode_cli(build_options& opt, error_messages& err)
     "SKETCHING (SUBSAMPLING)" %
         sketching_options_cli(opt.sketching, err)
     ,
+    "LOW-COMPLEXITY MASKING" %
+        masking_options_cli(opt.masking, err)
+    ,
+    "DEDUPLICATION" %
+        deduplication_options_cli(opt.dedup, err)
+    ,
     "ADVANCED OPTIONS" %
     (
         database_storage_options_cli(opt.dbconfig, err)
+        ,
+        (   option("-reader-threads") &
+            integer("#", opt.readerThreads)
+                .if_missing([&]{ err += "Number missing after '-reader-threads'!"; })
+        )
+            %("Number of threads that open, read and parse reference files "
+              "concurrently. Speeds up building from many small files. "
+              "Target order is not affected. 0: read in main thread only\n"
+              "default (on this machine): "s + to_string(opt.readerThreads))
+        ,
+        (   option("-max-read-ahead-size") &
+            integer("MiB", opt.maxReadAheadFileSize)
+                .if_missing([&]{ err += "Number missing after '-max-read-ahead-size'!"; })
+        )
+            %("Larger reference files are not read concurrently, "
+              "but streamed in the main thread. At most 4 files per "
+              "reader thread are held in memory.\n"
+              "default: "s + to_string(opt.maxReadAheadFileSize))
+        ,
+        (   option("-writer-threads") &
+            integer("#", opt.writerThreads)
+                .if_missing([&]{ err += "Number missing after '-writer-threads'!"; })
+        )
+            %("Number of threads that serialize the database concurrently "
+              "into independent blocks of the database file.\n"
+              "default (on this machine): "s + to_string(opt.writerThreads))
+        ,
+        (   option("-rehash-threads") &
+            integer("#", opt.rehashThreads)
+                .if_missing([&]{ err += "Number missing after '-rehash-threads'!"; })
+        )
+            %("Number of threads that rehash large feature hash tables "
+              "when they grow. The resulting database does not depend "
+              "on the number of threads. More than one thread needs "
+              "8 bytes of additional temporary memory per feature.\n"
+              "default (on this machine): "s + to_string(opt.rehashThreads))
+        ,
+        option("-fsync").set(opt.syncOnWrite)
+            %("Flushes the database file to disk before the build finishes.\n"
+              "default: "s + (opt.syncOnWrite ? "on" : "off"))
     ),
     catch_unknown(err)
     );
@@ -420,6 +530,15 @@ get_build_options(const cmdline_args& args, build_options opt)
     auto& sk = opt.sketching;
     if (sk.winstride < 0) sk.winstride = sk.winlen - sk.kmerlen + 1;
 
+    auto& mask = opt.masking;
+    if (mask.dustLevel < 1) mask.dustLevel = 1;
+    if (mask.dustWindow < 4) mask.dustWindow = 4;
+
+    if (opt.readerThreads < 0) opt.readerThreads = 0;
+    if (opt.maxReadAheadFileSize < 0) opt.maxReadAheadFileSize = 0;
+    if (opt.writerThreads < 1) opt.writerThreads = 1;
+    if (opt.rehashThreads < 1) opt.rehashThreads = 1;
+
     return opt;
 }
 
@@ -509,7 +628,11 @@ classification_params_cli(classification_options& opt, error_messages& err)
     )
         %(std::is_same<classification_candidates, distinct_matches_in_contiguous_window_ranges>() ?
             "Has no effect. (Requires selection of best_distinct_matches_... candidate generator in config.h)." :
-            "Maximum number of candidates to consider (before filtering!).\n"
+            "Maximum number of candidates (with the most hits) to consider "
+            "per query (before coverage filtering!); 0 = unlimited.\n"
+            "Previous versions ignored this option by default and reported "
+            "all candidates that pass '-hitmin' and '-hit-cutoff'; "
+            "use '-maxcand 0' to get their output.\n"
             "default: "s + to_string(opt.maxNumCandidatesPerQuery))
     ,
     ( 
@@ -530,6 +653,27 @@ classification_params_cli(classification_options& opt, error_messages& err)
         %("Sets classification coverage threshold to <t>\n"
           "Candidates on targets with lower coverage will be discarded.\n"
           "default: "s + to_string(opt.covMin))
+    ,
+    (
+        option("-cov-sample", "-coverage-sample") &
+        number("fraction", opt.covSampleFraction)
+            .if_missing([&]{ err += "Number missing after '-cov-sample'!"; })
+    )
+        %("Estimate target coverage (1st pass) from a deterministic subsample "
+          "of the queries of size <fraction> (or <fraction> percent if > 1) "
+          "and extrapolate it to all queries. "
+          "Speeds up querying of deep read sets.\n"
+          "default: "s + to_string(opt.covSampleFraction))
+    ,
+    (
+        option("-cov-sample-budget", "-coverage-sample-budget") &
+        integer("#", opt.covSampleBudget)
+            .if_missing([&]{ err += "Number missing after '-cov-sample-budget'!"; })
+    )
+        %("Estimate target coverage (1st pass) from about <#> queries "
+          "(reads or read pairs) that are evenly sampled from the input. "
+          "The number of queries in the input is estimated from file sizes.\n"
+          "default: "s + (opt.covSampleBudget > 0 ? to_string(opt.covSampleBudget) : "off"s))
 
     ,   
         option("-align").set(opt.align)
@@ -546,8 +690,46 @@ classification_params_cli(classification_options& opt, error_messages& err)
         %("Maximum allowed edit distance of alignments (enables -align). "
           "Alignments with higher edit distance will not be considered. "
           "Higher values increase runtime! "
-          "-1 = unlimited\n"
+          "-1 = automatic (see -align-error-rate)\n"
           "default: "s + to_string(opt.maxEditDist))
+    ,
+    (
+        option("-align-error-rate") &
+        number("rate", opt.alignErrorRate)
+            .if_missing([&]{ err += "Number missing after '-align-error-rate'!"; })
+    )
+        %("Expected fraction of edits (incl. nucleotide conversions) per read. "
+          "If no maximum edit distance is set, alignments start with a bound "
+          "of rate * read length that is doubled until an alignment is found. "
+          "0 = unbounded alignment (slow)\n"
+          "default: "s + to_string(opt.alignErrorRate))
+    ,
+        option("-lazy-align").set(opt.align).set(opt.lazyAlign)
+        %("Aligns candidates in descending hit order and skips candidates "
+          "whose hit deficit to the best alignment corresponds to more "
+          "edits than the score gap (enables -align). Only alignments within "
+          "the score gap of the best one are reported. Much faster for reads "
+          "with many mapping candidates.\n"
+          "default: "s + (opt.lazyAlign ? "on" : "off"))
+    ,
+    (
+        option("-align-gap", "-align-score-gap").set(opt.align).set(opt.lazyAlign) &
+        integer("#", opt.alignScoreGap)
+            .if_missing([&]{ err += "Number missing after '-align-gap'!"; })
+    )
+        %("Max. edit distance difference of reported alignments to the "
+          "best one (enables -lazy-align).\n"
+          "default: "s + to_string(opt.alignScoreGap))
+    ,
+        option("-adaptive-lookups", "-adaptive").set(opt.adaptiveLookups)
+        %("Find the location lists of all features of a query first and "
+          "collect them from small to large until the set of mapping "
+          "candidates can no longer change under the -hitmin / -hit-cutoff "
+          "rules (a list with n locations can add at most n hits to a "
+          "candidate and at most one per window of its window range). "
+          "Saves location lookups, but the hit counts of candidates can be "
+          "lower than without this option.\n"
+          "default: "s + (opt.adaptiveLookups ? "on" : "off"))
     ,   
         option("-no-cov-norm", "-no-norm-coverage").set(opt.covNorm, coverage_norm::none)
         %("Disable max norm of coverage statistic.\n"
@@ -562,6 +744,249 @@ classification_params_cli(classification_options& opt, error_messages& err)
 
 
 
+//-------------------------------------------------------------------
+/// @brief command line interface for ground truth based evaluation
+clipp::group
+classification_evaluation_cli(classification_evaluation_options& opt)
+{
+    using namespace clipp;
+
+    return (
+        option("-ground-truth", "-groundtruth")
+            .set(opt.determineGroundTruth).set(opt.showGroundTruth)
+            %("Report correct query taxa if known.\n"
+              "Queries need to have either a 'tgtid|<number>' entry in "
+              "their header or a sequence id that is also present in the "
+              "database.\n"
+              "This feature decreases querying speed!\n"
+              "default: "s + (opt.showGroundTruth ? "on" : "off"))
+        ,
+        option("-statistics").set(opt.statistics)
+            %("Report mapping statistics such as number of hits per read.\n"
+              "See: -accuracy for more stats.\n"
+              "default: "s + (opt.statistics ? "on" : "off"))
+        ,
+        option("-accuracy")
+            .set(opt.determineGroundTruth).set(opt.statistics)
+            %("Report accuracy statistics by comparing query origins "
+              "(ground truth) and mappings.\n"
+              "Queries need to have either a 'tgtid|<number>' entry in "
+              "their header or a sequence id that is also found in the "
+              "database. Equivalent to -ground-truth -statistics\n"
+              "This feature might decrease querying speed!\n"
+              "default: "s + (opt.determineGroundTruth && opt.statistics ? "on" : "off"))
+    );
+}
+
+
+
+//-------------------------------------------------------------------
+/**
+ * @brief parses comma-separated list of values and ranges 'first:last[:step]'
+ *        (default step: 1)
+ * @return false, if list contains invalid values
+ */
+template<class T>
+bool parse_value_list(const string& arg, std::vector<T>& values)
+{
+    std::istringstream is{arg};
+    string item;
+    while (std::getline(is, item, ',')) {
+        try {
+            std::size_t n = 0;
+            const double first = std::stod(item, &n);
+            if (n == item.size()) {
+                values.push_back(T(first));
+                continue;
+            }
+            if (item[n] != ':') return false;
+
+            item.erase(0, n+1);
+            const double last = std::stod(item, &n);
+            double step = 1.0;
+            if (n < item.size()) {
+                if (item[n] != ':') return false;
+                step = std::stod(item.substr(n+1));
+            }
+            if (step <= 0.0 || last < first) return false;
+
+            // tolerate rounding errors of fractional steps
+            const auto count = std::size_t((last - first) / step + 1e-9) + 1;
+            for (std::size_t i = 0; i < count; ++i) {
+                values.push_back(T(first + i * step));
+            }
+        }
+        catch(std::exception&) {
+            return false;
+        }
+    }
+    return !values.empty();
+}
+
+
+
+//-------------------------------------------------------------------
+/// @brief command line interface for classification parameter sweeps
+clipp::group
+parameter_sweep_cli(query_options& opt, error_messages& err)
+{
+    using namespace clipp;
+
+    const auto listOption = [&] (const string& name, auto& values) {
+        return (
+            option(name) &
+            value("list", [&,name](const string& arg) {
+                    if (!parse_value_list(arg, values))
+                        err += "Invalid value list after '" + name + "'!";
+                })
+                .if_missing([&,name]{ err += "Value list missing after '" + name + "'!"; })
+        );
+    };
+
+    return (
+        listOption("-sweep-hitmin", opt.sweep.hitsMin)
+            %("Evaluate classification threshold '-hitmin' for all values "
+              "in <list> (comma-separated values and/or ranges "
+              "'first:last[:step]'; e.g. '2,4:8:2'). "
+              "All sweep options replace the per-read output with one "
+              "table that lists the mapping rate (and accuracy, "
+              "see '-accuracy') for each combination of thresholds. "
+              "The reads are only processed twice regardless of the "
+              "number of combinations.\n"
+              "default: value of '-hitmin'")
+        ,
+        listOption("-sweep-hit-cutoff", opt.sweep.hitsCutoff)
+            %("Evaluate classification threshold '-hit-cutoff' for all values "
+              "in <list>.\n"
+              "default: value of '-hit-cutoff'")
+        ,
+        listOption("-sweep-cov-min", opt.sweep.covMin)
+            %("Evaluate coverage threshold '-cov-min' for all values "
+              "in <list>.\n"
+              "default: value of '-cov-min'")
+    );
+}
+
+
+
+//-------------------------------------------------------------------
+/// @brief command line interface for checkpointing
+clipp::group
+checkpoint_cli(checkpoint_options& opt, error_messages& err)
+{
+    using namespace clipp;
+
+    return (
+    (   option("-checkpoint") &
+        value("file", opt.filename)
+            .if_missing([&]{ err += "Filename missing after '-checkpoint'!"; })
+    )
+        %("Periodically save the query progress (input positions, "
+          "coverage state of the 1st pass, output file sizes, statistics) "
+          "to <file>. Requires mapping output to a file ('-out'); "
+          "not available for BAM output and parameter sweeps. "
+          "The checkpoint file is removed after a successful run.\n"
+          "default: none")
+    ,
+    (   option("-checkpoint-interval") &
+        integer("#", opt.interval)
+            .if_missing([&]{ err += "Number missing after '-checkpoint-interval'!"; })
+    )
+        %("Number of queries (reads or read pairs) between checkpoints.\n"
+          "default: "s + to_string(opt.interval))
+    ,
+    option("-resume").set(opt.resume)
+        %("Continue an interrupted run from the checkpoint file given with "
+          "'-checkpoint'. Output files are truncated to their state at the "
+          "last checkpoint and then appended to. "
+          "If the checkpoint file doesn't exist, all input is processed "
+          "from the beginning.\n"
+          "default: "s + (opt.resume ? "on" : "off"))
+    );
+}
+
+
+
+//-------------------------------------------------------------------
+/// @return adapter sequence for well-known adapter names
+string adapter_sequence(const string& name)
+{
+    if (name == "illumina") return "AGATCGGAAGAGC";
+    if (name == "nextera")  return "CTGTCTCTTATA";
+    if (name == "smallrna") return "TGGAATTCTCGG";
+    return name;
+}
+
+
+//-------------------------------------------------------------------
+/// @brief command line interface for read trimming
+clipp::group
+read_trimming_cli(read_trimming_options& opt, error_messages& err)
+{
+    using namespace clipp;
+
+    return (
+    repeatable(
+        option("-adapter", "-adapters") &
+        value("seq", [&](const string& arg) {
+                opt.adapters.push_back(adapter_sequence(arg));
+            })
+            .if_missing([&]{ err += "Sequence missing after '-adapter'!"; })
+    )
+        %("Removes adapter sequence <seq> and everything after it from the "
+          "3' end of each read (mate). Can be given multiple times. "
+          "Known names 'illumina', 'nextera' and 'smallrna' will be replaced "
+          "by the corresponding adapter sequence.\n"
+          "default: none")
+    ,
+    (   option("-adapter-overlap") &
+        integer("#", opt.adapterMinOverlap)
+            .if_missing([&]{ err += "Number missing after '-adapter-overlap'!"; })
+    )
+        %("Minimum overlap of read end and adapter.\n"
+          "default: "s + to_string(opt.adapterMinOverlap))
+    ,
+    (   option("-adapter-error-rate") &
+        number("r", opt.adapterMaxErrorRate)
+            .if_missing([&]{ err += "Number missing after '-adapter-error-rate'!"; })
+    )
+        %("Maximum fraction of mismatches in an adapter match.\n"
+          "default: "s + to_string(opt.adapterMaxErrorRate))
+    ,
+    (   option("-trim-poly-a", "-poly-a") &
+        integer("#", opt.polyAmin)
+            .if_missing([&]{ err += "Number missing after '-trim-poly-a'!"; })
+    )
+        %("Removes poly-A tails of at least <#> bases from 3' ends.\n"
+          "default: "s + (opt.polyAmin > 0 ? to_string(opt.polyAmin) : "off"s))
+    ,
+    (   option("-trim-poly-g", "-poly-g") &
+        integer("#", opt.polyGmin)
+            .if_missing([&]{ err += "Number missing after '-trim-poly-g'!"; })
+    )
+        %("Removes poly-G tails (e.g., from 2-color chemistry) of at least "
+          "<#> bases from 3' ends.\n"
+          "default: "s + (opt.polyGmin > 0 ? to_string(opt.polyGmin) : "off"s))
+    ,
+    (   option("-clip5") &
+        integer("#", opt.clip5)
+            .if_missing([&]{ err += "Number missing after '-clip5'!"; })
+    )
+        %("Removes <#> bases from the 5' end of each read (mate).\n"
+          "default: "s + to_string(opt.clip5))
+    ,
+    (   option("-clip3") &
+        integer("#", opt.clip3)
+            .if_missing([&]{ err += "Number missing after '-clip3'!"; })
+    )
+        %("Removes <#> bases from the 3' end of each read (mate) "
+          "after adapter and tail removal.\n"
+          "default: "s + to_string(opt.clip3))
+    );
+}
+
+
+
 //-------------------------------------------------------------------
 /// @brief build mode command-line options
 clipp::group
@@ -609,6 +1034,11 @@ classification_output_format_cli(classification_output_formatting& opt,
               "Note that in paired-end mode a query is a pair of two "
               "read sequences.\n"
               "default: "s + (opt.showQueryIds ? "on" : "off"))
+        ,
+        option("-show-aliases").set(opt.showAliases)
+            %("Reports all aliases of targets that were deduplicated "
+              "at build time ('-dedup'), separated by '/'.\n"
+              "default: "s + (opt.showAliases ? "on" : "off"))
     );
 }
 
@@ -655,8 +1085,9 @@ performance_options_cli(performance_tuning_options& opt, error_messages& err)
         integer("#", opt.bamThreads)
             .if_missing([&]{ err += "Number missing after '-bam-threads'!"; })
     )
-        %("Sets the maximum number of parallel thread to use for BAM processing. "
-          "(In addition to threads of -threads parameter.\n"
+        %("Sets the maximum number of parallel thread to use for BAM/CRAM encoding "
+          "and for compressing output files "
+          "(in addition to threads of -threads parameter).\n"
           "default: "s + to_string(opt.bamThreads))
     ,
     #endif
@@ -667,6 +1098,22 @@ performance_options_cli(performance_tuning_options& opt, error_messages& err)
         %("Process <#> many queries (reads or read pairs) per thread at once.\n"
           "default (on this machine): "s + to_string(opt.batchSize))
     ,
+    option("-auto-batch", "-autobatch").set(opt.autoTuneBatches)
+        %("Adapt the batch size and the number of batches in flight at "
+          "runtime to the measured processing time per query "
+          "(depends on read length, '-align', output format, ...). "
+          "'-batch-size' is used for the first batches. "
+          "The chosen values are shown in the summary.\n"
+          "default: "s + (opt.autoTuneBatches ? "on" : "off"))
+    ,
+    (   option("-batch-mem", "-batch-memory") &
+        integer("MB", opt.batchMemoryLimit)
+            .if_missing([&]{ err += "Number missing after '-batch-mem'!"; })
+    )
+        %("Memory budget for all query batches in flight "
+          "(only with '-auto-batch').\n"
+          "default: "s + to_string(opt.batchMemoryLimit))
+    ,
     #ifdef RMA_BAM
     (   option("-bam-buffer") &
         integer("t", opt.bamBufSize)
@@ -711,6 +1158,29 @@ query_mode_cli(query_options& opt, error_messages& err)
               "This can be used to load the database into memory only once "
               "and then query it multiple times with different query options. "
     ),
+    "MULTIPLE DATABASES" %
+    (
+        repeatable(
+            option("-add-db", "-add-database") &
+            value("database", opt.additionalDbfiles)
+                .if_missing([&]{ err += "Database filename missing after '-add-db'!"; })
+        )
+            %("Also map reads against <database>. Can be given multiple times. "
+              "Each read is parsed only once and then looked up in all "
+              "databases. Mappings for additional databases will be written "
+              "to separate files with names derived from the output filenames "
+              "(e.g. '-out res.txt -add-db lambda.db' => 'res_lambda.txt'). "
+              "All databases must have been built with the same sketching "
+              "parameters, because they share the hit thresholds.\n"
+              "default: none")
+        ,
+        option("-combined-out", "-combine-dbs").set(opt.output.combineDatabases)
+            %("Write the mappings for all databases into one table with one "
+              "group of result columns per database. This is always the case "
+              "if mappings are written to stdout. "
+              "SAM/BAM output is always written per database.\n"
+              "default: "s + (opt.output.combineDatabases ? "on" : "off"))
+    ),
     "MAPPING RESULTS OUTPUT" %
     (   option("-out") &
         value("file", opt.queryMappingsFile)
@@ -719,7 +1189,9 @@ query_mode_cli(query_options& opt, error_messages& err)
         % "Redirect output to file <file>.\n"
           "If not specified, output will be written to stdout. "
           "If more than one input file was given all output "
-          "will be concatenated into one file."
+          "will be concatenated into one file (see '-split-out'). "
+          "Files with extension '.gz' are written BGZF compressed "
+          "(requires a build with RMA_BAM=TRUE)."
     ,
     one_of(
         option("-sam").set(opt.output.samMode, sam_mode::sam).set(opt.output.showQueryParams, false)
@@ -744,9 +1216,75 @@ query_mode_cli(query_options& opt, error_messages& err)
         )
         %("Generates BAM format output in addition to default output. "
           "Output is redirected to <file>.")
+        ,
+        (
+        option("-with-cram-out").set(opt.output.samMode, sam_mode::cram) &
+        value("file", opt.samFile)
+            .if_missing([&]{ err += "Output filename missing after '-with-cram-out'!"; })
+        )
+        %("Generates CRAM format output in addition to default output. "
+          "Output is redirected to <file>. Reads are compressed against "
+          "the database's target sequences; decoding requires the same "
+          "reference sequences (e.g. the FASTA files the database was "
+          "built from).")
         #endif
     )
     ,
+    #ifdef RMA_BAM
+    option("-gz", "-gzip", "-bgzf").set(opt.output.compressFiles)
+        %("Compress mapping table and SAM output files with BGZF "
+          "(gzip compatible and indexable). Blocks are compressed "
+          "concurrently (see '-bam-threads'). Output files with "
+          "extension '.gz' are always compressed.\n"
+          "default: "s + (opt.output.compressFiles ? "on" : "off"))
+    ,
+    #endif
+    (
+        option("-binary-out") &
+        value("file", opt.binaryMappingsFile)
+            .if_missing([&]{ err += "Output filename missing after '-binary-out'!"; })
+    )
+        %("Write per-read mappings (top hits, window ranges, hits and "
+          "alignment summary) to <file> in a compact, block-compressed, "
+          "columnar binary format instead of the text mapping table. "
+          "Use mode 'convert' to turn it into the text mapping table.\n"
+          "default: none")
+    ,
+    option("-binary-no-headers").set(opt.output.binaryHeaders, false)
+        %("Store only query ids instead of read headers in binary output.\n"
+          "default: "s + (opt.output.binaryHeaders ? "off" : "on"))
+    ,
+    option("-conversion-calls", "-meth-calls").set(opt.output.showConversionCalls)
+                                              .set(opt.classify.align)
+        %("Add Bismark-style conversion (methylation) calls of each aligned "
+          "mate as SAM/BAM tags XM (call per nucleotide), XR (read conversion) "
+          "and XG (genome conversion). Assumes a directional library "
+          "(enables -align).\n"
+          "default: "s + (opt.output.showConversionCalls ? "on" : "off"))
+    ,
+    (
+        option("-conversion-table", "-meth-table").set(opt.classify.align) &
+        value("file", opt.conversionTableFile)
+            .if_missing([&]{ err += "Output filename missing after '-conversion-table'!"; })
+    )
+        %("Count converted and unconverted nucleotides per reference position "
+          "over all primary alignments and write the table to <file> "
+          "(enables -align). Positions covered by both mates are counted once.\n"
+          "default: none")
+    ,
+    option("-split-out", "-splitout").set(opt.splitOutputPerInput)
+        %("Write separate output files for each input file "
+          "(or each pair of input files if '-pairfiles' is set). "
+          "Output filenames are derived from the filenames given with "
+          "'-out' / '-with-sam-out': a placeholder '{sample}' is replaced "
+          "by the input file name (without extension), otherwise the name "
+          "is inserted before the file extension "
+          "(e.g. '-out res.txt' => 'res_sample1.txt'). "
+          "Without '-out' the output goes to '{sample}.txt' "
+          "(or '{sample}.sam' if '-sam' is set). "
+          "Several inputs are processed concurrently and share all threads.\n"
+          "default: "s + (opt.splitOutputPerInput ? "on" : "off"))
+    ,
     "PAIRED-END READ HANDLING" %
     (   one_of(
             option("-pairfiles", "-pair-files", "-paired-files")
@@ -773,6 +1311,9 @@ query_mode_cli(query_options& opt, error_messages& err)
               "default: sum of lengths of the individual reads"
     )
     ,
+    "READ TRIMMING" %
+        read_trimming_cli(opt.trimming, err)
+    ,
     "CLASSIFICATION" %
         classification_params_cli(opt.classify, err)
     ,
@@ -798,6 +1339,15 @@ query_mode_cli(query_options& opt, error_messages& err)
     ,
     classification_analysis_cli(opt.output.analysis)
     ,
+    "ADVANCED: GROUND TRUTH BASED EVALUATION" %
+        classification_evaluation_cli(opt.output.evaluate)
+    ,
+    "ANALYSIS: PARAMETER SWEEP" %
+        parameter_sweep_cli(opt, err)
+    ,
+    "CHECKPOINTS" %
+        checkpoint_cli(opt.checkpoint, err)
+    ,
     "ADVANCED: CUSTOM QUERY SKETCHING (SUBSAMPLING)" %
         sketching_options_cli(opt.sketching, err)
     ,
@@ -840,11 +1390,45 @@ get_query_options(const cmdline_args& args, query_options opt)
     auto& cl = opt.classify;
     if (cl.covMin > 1) cl.covMin *= 0.01;
     if (cl.hitsCutoff > 1) cl.hitsCutoff *= 0.01;
+    if (cl.covSampleFraction > 1) cl.covSampleFraction *= 0.01;
+    if (cl.covSampleFraction <= 0) cl.covSampleFraction = 1.0;
+    if (cl.alignScoreGap < 0) cl.alignScoreGap = 0;
+    if (cl.alignErrorRate > 1) cl.alignErrorRate *= 0.01;
+    if (cl.alignErrorRate < 0) cl.alignErrorRate = 0;
 
     if (cl.maxNumCandidatesPerQuery < 1) {
         cl.maxNumCandidatesPerQuery = std::numeric_limits<size_t>::max();
     }
 
+    auto& sweep = opt.sweep;
+    if (sweep.active()) {
+        for (auto& x : sweep.covMin)     if (x > 1) x *= 0.01;
+        for (auto& x : sweep.hitsCutoff) if (x > 1) x *= 0.01;
+
+        const auto normalize = [] (auto& values) {
+            std::sort(values.begin(), values.end());
+            values.erase(std::unique(values.begin(), values.end()), values.end());
+        };
+        normalize(sweep.hitsMin);
+        normalize(sweep.hitsCutoff);
+        normalize(sweep.covMin);
+
+        // sweep results replace per-read output
+        opt.output.format.showMapping = false;
+        opt.output.samMode = sam_mode::none;
+        opt.output.showConversionCalls = false;
+        opt.conversionTableFile.clear();
+        opt.binaryMappingsFile.clear();
+        cl.align = false;
+        // no per-read output => nothing to resume
+        opt.checkpoint = checkpoint_options{};
+    }
+
+    // binary output replaces text mapping table
+    if (!opt.binaryMappingsFile.empty()) opt.output.format.showMapping = false;
+
+    if (opt.checkpoint.interval < 1) opt.checkpoint.interval = 1;
+
 
     // processing option checks
     auto& perf = opt.performance;
@@ -853,7 +1437,7 @@ get_query_options(const cmdline_args& args, query_options opt)
     if (perf.queryLimit < 0) perf.queryLimit = 0;
 
     #ifdef RMA_BAM
-    if (opt.output.samMode == sam_mode::bam)
+    if (htslib_output(opt.output.samMode))
         perf.bamBufSize = 1 << perf.bamBufSize;
     else
         perf.bamBufSize = 1;
@@ -892,6 +1476,10 @@ string query_mode_examples() {
     "    Query multiple files and folder contents against database 'refseq':\n"
     "        rmapalign3n query refseq file1.fna folder1 file2.fna file3.fna folder2\n"
     "\n"
+    "    Map reads against database 'refseq' and a control database 'lambda' at once;\n"
+    "    control mappings are written to 'results_lambda.txt':\n"
+    "        rmapalign3n query refseq reads.fna -add-db lambda.db -out results.txt\n"
+    "\n"
     "    Load database in interactive query mode, then query multiple read batches\n"
     "        rmapalign3n query refseq\n"
     "        reads1.fa reads2.fa -pairfiles -insertsize 400\n"
@@ -1064,4 +1652,125 @@ string info_mode_docs() {
 
 
 
+
+/*************************************************************************//**
+ *
+ *
+ *  C O N V E R T   M O D E
+ *
+ *
+ *****************************************************************************/
+/// @brief command line interface for binary -> text mapping conversion
+clipp::group
+convert_mode_cli(convert_options& opt, error_messages& err)
+{
+    using namespace clipp;
+
+    auto& fmt = opt.format;
+
+    return (
+    "PARAMETERS" % (
+        value(match::prefix_not{"-"}, "binary file", opt.infile)
+            .if_missing([&]{ err += "Binary mapping filename is missing!"; })
+            % "binary mapping file (see query option '-binary-out')"
+        ,
+        catch_unknown(err)
+    ),
+    "OUTPUT" % (
+        (   option("-out") &
+            value("file", opt.outfile)
+                .if_missing([&]{ err += "Output filename missing after '-out'!"; })
+        )
+            % "Write mapping table to <file> instead of stdout."
+        ,
+        option("-queryids", "-query-ids", "-query-id", "-queryid").set(fmt.showQueryIds)
+            %("Show a unique id for each query.\n"
+              "default: "s + (fmt.showQueryIds ? "on" : "off"))
+        ,
+        option("-locations").set(opt.showLocations)
+            %("Show locations in candidate reference sequences.\n"
+              "default: "s + (opt.showLocations ? "on" : "off"))
+        ,
+        (   option("-separator") &
+            value("text", [&](const string& arg) {
+                    fmt.tokens.column = sanitize_special_chars(arg);
+                })
+                .if_missing([&]{ err += "Text missing after '-separator'!"; })
+        )
+            % "Sets string that separates output columns.\n"
+              "default: '\\t|\\t'"
+        ,
+        (   option("-comment") &
+            value("text", fmt.tokens.comment)
+                .if_missing([&]{ err += "Text missing after '-comment'!"; })
+        )
+            %("Sets string that precedes comment (non-mapping) lines.\n"
+              "default: '"s + fmt.tokens.comment + "'")
+    )
+    );
+}
+
+
+
+//-------------------------------------------------------------------
+convert_options
+get_convert_options(const cmdline_args& args)
+{
+    convert_options opt;
+    error_messages err;
+
+    auto cli = convert_mode_cli(opt, err);
+
+    auto result = clipp::parse(args, cli);
+
+    if (!result || err.any()) {
+        raise_default_error(err, "convert", convert_mode_usage());
+    }
+
+    return opt;
+}
+
+
+
+//-------------------------------------------------------------------
+string convert_mode_usage()
+{
+    convert_options opt;
+    error_messages err;
+    const auto cli = convert_mode_cli(opt, err);
+    return clipp::usage_lines(cli, "rmapalign3n convert", cli_usage_formatting()).str();
+}
+
+
+
+//-------------------------------------------------------------------
+string convert_mode_docs() {
+
+    convert_options opt;
+    error_messages err;
+    const auto cli = convert_mode_cli(opt, err);
+
+    string docs = "SYNOPSIS\n\n";
+
+    docs += clipp::usage_lines(cli, "rmapalign3n convert", cli_usage_formatting()).str();
+
+    docs += "\n\n\n"
+        "DESCRIPTION\n"
+        "\n"
+        "    Converts binary mapping output (query option '-binary-out')\n"
+        "    into the default text mapping table.\n"
+        "\n\n";
+
+    docs += clipp::documentation{cli, cli_doc_formatting()}.str();
+
+    docs += "\n\n\nEXAMPLES\n\n"
+        "    Map reads with binary output and convert to text table:\n"
+        "        rmapalign3n query refdb reads.fa -binary-out res.bin\n"
+        "        rmapalign3n convert res.bin -out res.txt\n";
+
+    return docs;
+}
+
+
+
 } // namespace mc
@@ -24,6 +24,7 @@
 #define RMA_CMDLINE_INTERFACE_H_
 
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <cstdint>
@@ -41,6 +42,9 @@
 
 namespace mc {
 
+// forward declarations
+class thread_budget;
+
 
 /*************************************************************************//**
  *
@@ -108,6 +112,40 @@ struct database_storage_options
  *
  *****************************************************************************/
 
+/*************************************************************************//**
+ *
+ * @brief low-complexity masking of reference sequences;
+ *        masked nucleotides don't produce any features
+ *
+ *****************************************************************************/
+struct masking_options
+{
+    // DUST: mask windows whose triplet score exceeds 'dustLevel'
+    bool dust = false;
+    int dustLevel = 20;
+    int dustWindow = 64;
+
+    // mask lower case (soft-masked) nucleotides
+    bool softMasked = false;
+
+    bool active() const noexcept { return dust || softMasked; }
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief store reference sequences with identical content as aliases
+ *        of one canonical target (detected by content hash)
+ *
+ *****************************************************************************/
+struct deduplication_options
+{
+    bool identical = false;
+};
+
+
+
 /*************************************************************************//**
  *
  * @brief database creation parameters
@@ -120,6 +158,20 @@ struct build_options
 
     sketching_options sketching;
     database_storage_options dbconfig;
+    masking_options masking;
+    deduplication_options dedup;
+
+    // read and parse reference files concurrently (0: main thread only)
+    int readerThreads = std::min(4, int(std::thread::hardware_concurrency()));
+    // larger files are streamed instead of being read ahead (in MiB)
+    int maxReadAheadFileSize = 16;
+
+    // serialize hash table concurrently when writing the database
+    int writerThreads = std::min(4, int(std::thread::hardware_concurrency()));
+    // rehash large feature hash tables concurrently
+    int rehashThreads = std::max(1, int(std::thread::hardware_concurrency()));
+    // flush database file to disk before returning
+    bool syncOnWrite = false;
 
     info_level infoLevel = info_level::moderate;
 };
@@ -206,8 +258,18 @@ struct target_print_style {
 struct performance_tuning_options {
     int numThreads = std::thread::hardware_concurrency();
     std::size_t batchSize = 4096;
+    // adapt batch size and number of batches in flight at runtime
+    bool autoTuneBatches = false;
+    // memory budget for all query batches in MB (only with auto tuning)
+    std::size_t batchMemoryLimit = 1024;
     //limits number of reads per sequence source (file)
     std::int_least64_t queryLimit = std::numeric_limits<std::int_least64_t>::max();
+    //fraction of queries that will be processed (selected by query id)
+    double queryFraction = 1.0;
+
+    // set at runtime if samples are processed concurrently:
+    // worker threads can be taken over from finished samples
+    thread_budget* sharedThreads = nullptr;
 
     #ifdef RMA_BAM
     size_t bamBufSize = 25;
@@ -216,6 +278,30 @@ struct performance_tuning_options {
 };
 
 
+/*************************************************************************//**
+ *
+ * @brief read trimming; applied to each read after parsing and before sketching
+ *
+ *****************************************************************************/
+struct read_trimming_options
+{
+    // adapter sequences that will be removed from the 3' end of reads
+    std::vector<std::string> adapters;
+    // minimum overlap of read end and adapter prefix
+    int adapterMinOverlap = 3;
+    // maximum fraction of mismatches in an adapter match
+    double adapterMaxErrorRate = 0.1;
+
+    // minimum length of poly-A / poly-G tails (0 : don't remove tails)
+    int polyAmin = 0;
+    int polyGmin = 0;
+
+    // number of bases to remove from 5' / 3' end after adapter/tail removal
+    int clip5 = 0;
+    int clip3 = 0;
+};
+
+
 /*************************************************************************//**
  *
  * @brief classification options
@@ -243,10 +329,61 @@ struct classification_options
     coverage_norm covNorm = coverage_norm::max;
     coverage_fill covFill = coverage_fill::matches;
 
+    // coverage (1st pass) is estimated from a subsample of the queries:
+    // fraction of queries / approx. number of queries (0: no budget)
+    double covSampleFraction = 1.0;
+    std::size_t covSampleBudget = 0;
+
+    // stop looking up features of a query as soon as the
+    // result can no longer change
+    bool adaptiveLookups = false;
+
     // alignment mode
     bool align = false;
-    int maxEditDist = -1;
+    int maxEditDist = -1;  // < 0: automatic bound based on 'alignErrorRate'
+    // expected rate of edits incl. nucleotide conversions;
+    // initial edlib bound, doubled until an alignment is found (0: unbounded)
+    double alignErrorRate = 0.3;
+    // align in descending hit order; skip candidates that are not expected
+    // to come within 'alignScoreGap' edits of the best alignment
+    bool lazyAlign = false;
+    int alignScoreGap = 2;
+
+};
+
+
+/*************************************************************************//**
+ *
+ * @brief grid of classification thresholds that are evaluated
+ *        in one run; empty lists: use value from classification options
+ *
+ *****************************************************************************/
+struct parameter_sweep_options
+{
+    std::vector<int> hitsMin;
+    std::vector<double> hitsCutoff;
+    std::vector<double> covMin;
 
+    bool active() const noexcept {
+        return !hitsMin.empty() || !hitsCutoff.empty() || !covMin.empty();
+    }
+};
+
+
+/*************************************************************************//**
+ *
+ * @brief periodic saving of the query progress; allows to resume
+ *        interrupted runs
+ *
+ *****************************************************************************/
+struct checkpoint_options
+{
+    // empty: no checkpoints
+    std::string filename;
+    // number of queries (per sequence source) between checkpoints
+    std::int_least64_t interval = 1000000;
+    // continue from checkpoint (if checkpoint file exists)
+    bool resume = false;
 };
 
 
@@ -305,6 +442,9 @@ struct classification_output_formatting
 
     bool showQueryIds = false;
 
+    // expand deduplicated targets to all of their aliases
+    bool showAliases = false;
+
     target_print_style targetStyle;
 
     formatting_tokens tokens;
@@ -329,9 +469,17 @@ enum class sam_mode {
     sam
     #ifdef RMA_BAM
     ,bam
+    ,cram
     #endif
 };
 
+#ifdef RMA_BAM
+/// @brief BAM and CRAM records are encoded by htslib
+constexpr bool htslib_output(sam_mode mode) noexcept {
+    return mode == sam_mode::bam || mode == sam_mode::cram;
+}
+#endif
+
 /*************************************************************************//**
  *
  * @brief classification output options
@@ -348,9 +496,24 @@ struct classification_output_options
     bool showSummary = true;
     bool showDBproperties = false;
     bool showErrors = true;
+    // progress indicator on stderr
+    bool showProgress = true;
 
-    //  SAM / BAM output
+    //  SAM / BAM / CRAM output
     sam_mode samMode = sam_mode::none;
+
+    #ifdef RMA_BAM
+    // BGZF-compressed mapping table / SAM files (always for '*.gz')
+    bool compressFiles = false;
+    #endif
+    // Bismark-style conversion call tags (XM, XR, XG) in SAM / BAM output
+    bool showConversionCalls = false;
+
+    // store query headers in binary mapping output (otherwise only ids)
+    bool binaryHeaders = true;
+
+    // one mapping table with result columns for all databases
+    bool combineDatabases = false;
 };
 
 
@@ -362,6 +525,8 @@ struct classification_output_options
 struct query_options
 {
     std::string dbfile;
+    // additional databases that are queried with the same reads
+    std::vector<std::string> additionalDbfiles;
     std::vector<std::string> infiles;
 
     // how to pair up reads
@@ -372,6 +537,10 @@ struct query_options
     // output filename for mappings per read
     std::string queryMappingsFile;
     std::string samFile;
+    // per-position conversion counts of primary alignments
+    std::string conversionTableFile;
+    // compact binary mapping output (replaces mapping table)
+    std::string binaryMappingsFile;
 
     database_storage_options dbconfig;
 
@@ -380,9 +549,14 @@ struct query_options
 
     performance_tuning_options performance;
 
+    read_trimming_options trimming;
+
     classification_options classify;
     classification_output_options output;
 
+    parameter_sweep_options sweep;
+
+    checkpoint_options checkpoint;
 };
 
 
@@ -440,6 +614,40 @@ std::string info_mode_usage();
 std::string info_mode_examples();
 std::string info_mode_docs();
 
+
+
+/*************************************************************************//**
+ *
+ *
+ *  C O N V E R T   M O D E
+ *
+ *
+ *****************************************************************************/
+struct convert_options {
+    // binary mapping file
+    std::string infile;
+    // text mapping table; stdout if empty
+    std::string outfile;
+
+    classification_output_formatting format;
+    bool showLocations = false;
+};
+
+
+
+/*************************************************************************//**
+ * @brief command line args -> convert mode options
+ *****************************************************************************/
+convert_options get_convert_options(const cmdline_args&);
+
+
+
+/*************************************************************************//**
+ * @brief convert mode documentation
+ *****************************************************************************/
+std::string convert_mode_usage();
+std::string convert_mode_docs();
+
 } // namespace mc
 
 
@@ -0,0 +1,474 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef RMA_PACKED_SEQUENCE_H_
+#define RMA_PACKED_SEQUENCE_H_
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "dna_encoding.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief 2-bit nucleotide codes (A=0, C=1, G=2, T=3)
+ *
+ *****************************************************************************/
+inline std::uint8_t
+nucleotide_code(char c) noexcept
+{
+    switch(c) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return 4;
+    }
+}
+
+//-------------------------------------------------------------------
+inline char
+nucleotide_char(std::uint8_t code) noexcept
+{
+    return "ACGT"[code & 3];
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief spreads the 32 bits of 'x' to the even bit positions of a 64-bit word
+ *
+ *****************************************************************************/
+inline constexpr std::uint64_t
+spread_bits_2(std::uint64_t x) noexcept
+{
+    x &= 0x00000000FFFFFFFFull;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x <<  8)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x <<  4)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x <<  2)) & 0x3333333333333333ull;
+    x = (x | (x <<  1)) & 0x5555555555555555ull;
+    return x;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief non-owning view of a 2-bit packed nucleotide sequence
+ *
+ *        32 nucleotides are stored per 64-bit word (first one in lowest bits).
+ *        Characters other than ACGT (upper/lower case) are marked in an
+ *        optional ambiguity bit mask (64 positions per word) and their
+ *        original values are kept in a separate character array so that
+ *        unpacking restores them. Lower case ACGT is unpacked as upper case.
+ *
+ *        A view covers the positions [first, last) of the underlying storage.
+ *
+ *****************************************************************************/
+class packed_sequence_view
+{
+public:
+    using size_type = std::size_t;
+
+
+    /*************************************************************************//**
+     * @brief random access iterator over positions; dereferences to characters
+     *        (ambiguous positions yield 'N')
+     *****************************************************************************/
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = char;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const char*;
+        using reference         = char;
+
+        const_iterator() = default;
+
+        const_iterator(const packed_sequence_view* seq, size_type pos) noexcept:
+            seq_{seq}, pos_{pos}
+        {}
+
+        char operator * () const noexcept { return seq_->char_at(pos_); }
+
+        const_iterator& operator ++ () noexcept { ++pos_; return *this; }
+        const_iterator& operator -- () noexcept { --pos_; return *this; }
+        const_iterator operator ++ (int) noexcept { auto i = *this; ++pos_; return i; }
+        const_iterator operator -- (int) noexcept { auto i = *this; --pos_; return i; }
+
+        const_iterator& operator += (difference_type n) noexcept { pos_ += n; return *this; }
+        const_iterator& operator -= (difference_type n) noexcept { pos_ -= n; return *this; }
+
+        friend const_iterator operator + (const_iterator i, difference_type n) noexcept { return i += n; }
+        friend const_iterator operator + (difference_type n, const_iterator i) noexcept { return i += n; }
+        friend const_iterator operator - (const_iterator i, difference_type n) noexcept { return i -= n; }
+
+        friend difference_type operator - (const const_iterator& a, const const_iterator& b) noexcept {
+            return difference_type(a.pos_) - difference_type(b.pos_);
+        }
+
+        friend bool operator == (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ == b.pos_; }
+        friend bool operator != (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ != b.pos_; }
+        friend bool operator <  (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ <  b.pos_; }
+        friend bool operator <= (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ <= b.pos_; }
+        friend bool operator >  (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ >  b.pos_; }
+        friend bool operator >= (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ >= b.pos_; }
+
+        const packed_sequence_view& sequence() const noexcept { return *seq_; }
+        size_type position() const noexcept { return pos_; }
+
+    private:
+        const packed_sequence_view* seq_ = nullptr;
+        size_type pos_ = 0;
+    };
+
+
+    //---------------------------------------------------------------
+    packed_sequence_view() = default;
+
+    packed_sequence_view(const std::uint64_t* codes, const std::uint64_t* ambig,
+                         const char* ambigChars, size_type length,
+                         size_type first, size_type last) noexcept
+    :
+        codes_{codes}, ambig_{ambig}, ambigChars_{ambigChars},
+        length_{length}, first_{first}, last_{last}
+    {}
+
+
+    //---------------------------------------------------------------
+    size_type size()  const noexcept { return last_ - first_; }
+    bool      empty() const noexcept { return last_ <= first_; }
+
+    size_type first() const noexcept { return first_; }
+    size_type last()  const noexcept { return last_; }
+
+    const_iterator begin() const noexcept { return const_iterator{this, first_}; }
+    const_iterator end()   const noexcept { return const_iterator{this, last_}; }
+
+    /** @return view of positions [first, last) of the same storage */
+    packed_sequence_view
+    subview(size_type first, size_type last) const noexcept {
+        return packed_sequence_view{codes_, ambig_, ambigChars_, length_, first, last};
+    }
+
+
+    //---------------------------------------------------------------
+    bool has_ambiguous() const noexcept { return ambig_ != nullptr; }
+
+    std::uint8_t code_at(size_type pos) const noexcept {
+        return (codes_[pos >> 5] >> ((pos & 31) << 1)) & 3;
+    }
+
+    bool ambiguous_at(size_type pos) const noexcept {
+        return ambig_ && ((ambig_[pos >> 6] >> (pos & 63)) & 1);
+    }
+
+    char char_at(size_type pos) const noexcept {
+        return ambiguous_at(pos) ? 'N' : nucleotide_char(code_at(pos));
+    }
+
+
+    //---------------------------------------------------------------
+    /** @return codes of the (up to) 32 positions starting at 'pos' */
+    std::uint64_t codes_from(size_type pos) const noexcept {
+        const auto w = pos >> 5;
+        const auto s = (pos & 31) << 1;
+        auto x = codes_[w] >> s;
+        if (s > 0 && ((w+1) << 5) < length_) x |= codes_[w+1] << (64 - s);
+        return x;
+    }
+
+    /** @return ambiguity flags of the (up to) 32 positions starting at 'pos' */
+    std::uint32_t ambiguity_from(size_type pos) const noexcept {
+        if (!ambig_) return 0;
+        const auto w = pos >> 6;
+        const auto s = pos & 63;
+        auto x = ambig_[w] >> s;
+        if (s > 32 && ((w+1) << 6) < length_) x |= ambig_[w+1] << (64 - s);
+        return std::uint32_t(x);
+    }
+
+
+    //---------------------------------------------------------------
+    /** @brief writes viewed range as characters to 'out' */
+    void unpack(std::string& out) const
+    {
+        out.resize(size());
+        if (empty()) return;
+
+        // index of first ambiguous character in view
+        size_type ambigIdx = 0;
+        if (ambig_) {
+            for (size_type w = 0; w < (first_ >> 6); ++w) {
+                ambigIdx += __builtin_popcountll(ambig_[w]);
+            }
+            if (first_ & 63) {
+                ambigIdx += __builtin_popcountll(
+                    ambig_[first_ >> 6] & ((std::uint64_t(1) << (first_ & 63)) - 1));
+            }
+        }
+
+        char* o = &out[0];
+        for (size_type i = first_; i < last_; ++i, ++o) {
+            if (ambiguous_at(i)) {
+                *o = ambigChars_[ambigIdx++];
+            } else {
+                *o = nucleotide_char(code_at(i));
+            }
+        }
+    }
+
+
+private:
+    const std::uint64_t* codes_ = nullptr;
+    const std::uint64_t* ambig_ = nullptr;
+    const char* ambigChars_ = nullptr;
+    size_type length_ = 0;  // of underlying storage
+    size_type first_ = 0;
+    size_type last_ = 0;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief loops through all non-ambiguous 2-bit encoded k-mers of a
+ *        packed sequence range; reads nucleotide codes directly from the
+ *        packed representation (no character decoding)
+ *
+ *        (overload of the generic character range version in dna_encoding.h)
+ *
+ *****************************************************************************/
+template<class UInt, class Consumer>
+inline void
+for_each_unambiguous_converted_kmer_2bit(
+    numk_t k, char orig, char repl,
+    packed_sequence_view::const_iterator first,
+    packed_sequence_view::const_iterator last,
+    Consumer&& consume)
+{
+    static_assert(std::is_integral<UInt>::value &&
+                  std::is_unsigned<UInt>::value,
+                  "only unsigned integer types are supported");
+
+    const auto& seq = first.sequence();
+    const auto origCode = nucleotide_code(orig);
+    const auto replCode = nucleotide_code(repl);
+
+    auto kmer    = UInt(0);
+    auto kmerMsk = UInt(~0);
+    kmerMsk >>= (sizeof(kmerMsk) * CHAR_BIT) - (k * 2);
+
+    // number of letters since last ambiguous letter
+    numk_t valid = 0;
+
+    for (auto i = first.position(), e = last.position(); i < e; ++i) {
+        auto c = seq.code_at(i);
+        bool ambig = seq.ambiguous_at(i);
+        if (c == origCode) {
+            if (replCode < 4) c = replCode; else ambig = true;
+        }
+        kmer = ((kmer << 2) | c) & kmerMsk;
+
+        if (ambig) {
+            valid = 0;
+        }
+        else if (valid < k) {
+            ++valid;
+        }
+        if (valid == k) consume(kmer);
+    }
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief 2-bit packing of character sequences into a word buffer
+ *
+ *****************************************************************************/
+struct packed_sequence_layout
+{
+    using size_type = std::size_t;
+
+    static constexpr size_type npos = size_type(~0);
+
+    static constexpr size_type code_words(size_type n) noexcept {
+        return (n + 31) / 32;
+    }
+    static constexpr size_type ambig_words(size_type n) noexcept {
+        return (n + 63) / 64;
+    }
+
+    /**
+     * @brief packs 'seq' into 'buf' starting at word index 'offset';
+     *        appends ambiguous characters to 'ambigChars'
+     *        and sets 'codes', 'ambig', 'length'
+     * @return word index one after packed data
+     */
+    template<class Sequence>
+    size_type pack(const Sequence& seq, std::vector<std::uint64_t>& buf,
+                   size_type offset, std::string& ambigChars)
+    {
+        const auto n = seq.size();
+        length = n;
+        first = 0;
+        last = n;
+        codes = offset;
+        ambig = npos;
+        chars = ambigChars.size();
+
+        const auto nc = code_words(n);
+        if (buf.size() < offset + nc) buf.resize(offset + nc);
+        std::uint64_t* w = buf.data() + offset;
+
+        size_type numAmbig = 0;
+        for (size_type i = 0; i < n; i += 32) {
+            std::uint64_t x = 0;
+            const auto e = std::min(n, i + 32);
+            for (size_type j = i; j < e; ++j) {
+                auto c = nucleotide_code(seq[j]);
+                if (c > 3) { ++numAmbig; c = 0; }
+                x |= std::uint64_t(c) << ((j - i) << 1);
+            }
+            w[i >> 5] = x;
+        }
+        offset += nc;
+
+        if (numAmbig > 0) {
+            ambig = offset;
+            const auto na = ambig_words(n);
+            if (buf.size() < offset + na) buf.resize(offset + na);
+            w = buf.data() + offset;
+            std::fill(w, w + na, 0);
+            for (size_type j = 0; j < n; ++j) {
+                if (nucleotide_code(seq[j]) > 3) {
+                    w[j >> 6] |= std::uint64_t(1) << (j & 63);
+                    ambigChars.push_back(seq[j]);
+                }
+            }
+            offset += na;
+        }
+        return offset;
+    }
+
+    /**
+     * @brief packs the characters returned by 'next' (a negative value
+     *        marks the end of the sequence) into 'buf' starting at word
+     *        index 'offset' without an intermediate character buffer;
+     *        appends ambiguous characters to 'ambigChars'
+     *        and sets 'codes', 'ambig', 'length'
+     * @param ambigPos  reusable buffer for positions of ambiguous characters
+     * @return word index one after packed data
+     */
+    template<class CharSource>
+    size_type pack_from(CharSource&& next, std::vector<std::uint64_t>& buf,
+                        size_type offset, std::string& ambigChars,
+                        std::vector<size_type>& ambigPos)
+    {
+        codes = offset;
+        ambig = npos;
+        chars = ambigChars.size();
+        ambigPos.clear();
+
+        const auto put = [&] (std::uint64_t x) {
+            if (offset < buf.size()) buf[offset] = x; else buf.push_back(x);
+            ++offset;
+        };
+
+        size_type n = 0;
+        std::uint64_t x = 0;
+        for (int c = next(); c >= 0; c = next()) {
+            auto code = nucleotide_code(char(c));
+            if (code > 3) {
+                ambigPos.push_back(n);
+                ambigChars.push_back(char(c));
+                code = 0;
+            }
+            x |= std::uint64_t(code) << ((n & 31) << 1);
+            if ((++n & 31) == 0) {
+                put(x);
+                x = 0;
+            }
+        }
+        if (n & 31) put(x);
+
+        length = n;
+        first = 0;
+        last = n;
+
+        if (!ambigPos.empty()) {
+            ambig = offset;
+            const auto na = ambig_words(n);
+            if (buf.size() < offset + na) buf.resize(offset + na);
+            std::uint64_t* w = buf.data() + offset;
+            std::fill(w, w + na, 0);
+            for (auto j : ambigPos) {
+                w[j >> 6] |= std::uint64_t(1) << (j & 63);
+            }
+            offset += na;
+        }
+        return offset;
+    }
+
+    /** @return word index one after packed data */
+    size_type words_end() const noexcept {
+        return ambig != npos ? ambig + ambig_words(length)
+                             : codes + code_words(length);
+    }
+
+    packed_sequence_view
+    view(const std::vector<std::uint64_t>& buf, const std::string& ambigChars) const noexcept
+    {
+        return packed_sequence_view{
+            buf.data() + codes,
+            ambig != npos ? buf.data() + ambig : nullptr,
+            ambigChars.data() + chars,
+            length, first, last};
+    }
+
+    size_type codes = 0;
+    size_type ambig = npos;
+    size_type chars = 0;
+    size_type length = 0;
+    size_type first = 0;
+    size_type last = 0;
+};
+
+
+} // namespace mc
+
+
+#endif
@@ -61,6 +61,21 @@ void show_query_parameters(std::ostream& os, const database& db, const query_opt
            << comment << "  Max insert size considered " << opt.classify.insertSizeMax << ".\n";
     }
 
+    const auto& trim = opt.trimming;
+    for (const auto& adapter : trim.adapters) {
+        os << comment << "Trimming adapter " << adapter << '\n';
+    }
+    if (trim.polyAmin > 0) {
+        os << comment << "Trimming poly-A tails (min. length " << trim.polyAmin << ")\n";
+    }
+    if (trim.polyGmin > 0) {
+        os << comment << "Trimming poly-G tails (min. length " << trim.polyGmin << ")\n";
+    }
+    if (trim.clip5 > 0 || trim.clip3 > 0) {
+        os << comment << "Clipping " << trim.clip5 << " (5') / "
+           << trim.clip3 << " (3') bases per read\n";
+    }
+
     os << comment << "Using " << opt.performance.numThreads << " threads\n";
 
     auto s = db.query_sketcher();
@@ -73,7 +88,7 @@ void show_query_parameters(std::ostream& os, const database& db, const query_opt
        << "Window length / stride / size (sketch): "
        << s.window_size() << " / " << s.window_stride() << " / " << s.sketch_size() << '\n';
     
-    if (std::is_same<classification_candidates, best_distinct_matches_in_contiguous_window_ranges>()) {
+    if (!std::is_same<classification_candidates, distinct_matches_in_contiguous_window_ranges>()) {
         os << comment
            << "At maximum "
            << opt.classify.maxNumCandidatesPerQuery
@@ -100,6 +115,23 @@ void show_query_parameters(std::ostream& os, const database& db, const query_opt
     if (opt.classify.covFill == coverage_fill::fill) {
         os << "Coverage includes caps. (2nd coverage condition waived.)\n";
     }
+
+    if (opt.classify.covSampleFraction < 1.0) {
+        os << comment << "Coverage is estimated from "
+           << (100 * opt.classify.covSampleFraction) << "% of the queries\n";
+    }
+    if (opt.classify.covSampleBudget > 0) {
+        os << comment << "Coverage is estimated from about "
+           << opt.classify.covSampleBudget << " queries\n";
+    }
+
+    if (opt.sweep.active()) {
+        os << comment << "Parameter sweep over "
+           << std::max(std::size_t(1), opt.sweep.hitsMin.size()) << " x "
+           << std::max(std::size_t(1), opt.sweep.hitsCutoff.size()) << " x "
+           << std::max(std::size_t(1), opt.sweep.covMin.size())
+           << " (hitmin x hit cutoff x coverage cutoff) thresholds\n";
+    }
 }
 
 
@@ -163,13 +195,19 @@ void show_target(std::ostream& os,
 //-------------------------------------------------------------------
 void show_candidates(std::ostream& os,
                      const database& db,
-                     const classification_candidates& cands)
+                     const classification_candidates& cands,
+                     bool showAliases)
 {
     using size_t = classification_candidates::size_type;
 
     for (size_t i = 0; i < cands.size(); ++i) {
         if (i > 0) os << ',';
-        os << db.get_target(cands[i].tgt).name() << ':' << cands[i].hits;
+        const auto& tgt = db.get_target(cands[i].tgt);
+        os << tgt.name();
+        if (showAliases) {
+            for (const auto& a : tgt.aliases()) os << '/' << a.name;
+        }
+        os << ':' << cands[i].hits;
     }
 
 }
@@ -258,6 +296,50 @@ void show_accuracy(std::ostream& os,
 
 
 
+/*************************************************************************//**
+ *
+ * @brief prints mapping rate (and accuracy) for each point
+ *        of a parameter sweep
+ *
+ *****************************************************************************/
+void show_sweep_results(const query_options& opt,
+                        const classification_results& results)
+{
+    if (results.sweep.empty()) return;
+
+    auto& os = results.mainOut;
+    const auto& colsep = opt.output.format.tokens.column;
+    const auto& comment = opt.output.format.tokens.comment;
+    const bool accuracy = opt.output.evaluate.determineGroundTruth;
+
+    os << comment << "Parameter sweep results:\n"
+       << comment << "TABLE_LAYOUT: "
+       << "hitmin" << colsep << "hit_cutoff" << colsep << "cov_min" << colsep
+       << "reads_mapped" << colsep << "mapping_rate" << colsep
+       << "hits_per_read";
+    if (accuracy) {
+        os << colsep << "origin_found" << colsep << "correctly_rejected"
+           << colsep << "recall" << colsep << "mean_true_hit_rate";
+    }
+    os << '\n';
+
+    for (const auto& point : results.sweep) {
+        const auto& stats = point.statistics;
+        os << point.hitsMin << colsep << point.hitsCutoff << colsep
+           << point.covMin << colsep << stats.aligned() << colsep
+           << (stats.total() > 0 ? double(stats.aligned()) / stats.total() : 0.0)
+           << colsep << stats.hits_per_read();
+        if (accuracy) {
+            os << colsep << stats.correct() << colsep << stats.true_negatives()
+               << colsep << stats.recall() << colsep
+               << (stats.aligned() > 0 ? stats.mean_true_hit_rate() : 0.0);
+        }
+        os << '\n';
+    }
+}
+
+
+
 /*************************************************************************//**
  *
  * @brief show summary and statistics of classification
@@ -266,7 +348,9 @@ void show_accuracy(std::ostream& os,
 void show_summary(const query_options& opt,
                   const classification_results& results)
 {
-    const auto& statistics = results.statistics;
+    // sweep: each grid point saw all queries
+    const auto& statistics = results.sweep.empty()
+                           ? results.statistics : results.sweep.front().statistics;
     const auto numQueries = (opt.pairing == pairing_mode::none)
                             ? statistics.total() : 2 * statistics.total();
 
@@ -277,8 +361,24 @@ void show_summary(const query_options& opt,
         << comment << "time:    " << results.time.milliseconds() << " ms\n"
         << comment << "speed:   " << speed << " queries/min\n";
 
+    const auto& batching = results.batching;
+    if (opt.performance.autoTuneBatches && batching.batch_size() > 0) {
+        results.mainOut
+            << comment << "batch size: " << batching.batch_size()
+            << " (auto-tuned, " << batching.batches_in_flight()
+            << " batches in flight)\n";
+    }
+
+    const auto& lookups = results.lookups;
+    if (opt.classify.adaptiveLookups && lookups.total() > 0) {
+        results.mainOut
+            << comment << "location lookups: " << lookups.performed()
+            << " (adaptive mode saved " << lookups.skipped() << " = "
+            << (100.0 * lookups.skipped() / lookups.total()) << "%)\n";
+    }
+
     if (statistics.total() > 0) {
-        if (opt.output.evaluate.statistics) {
+        if (opt.output.evaluate.statistics && results.sweep.empty()) {
             if (opt.output.evaluate.determineGroundTruth)
                 show_accuracy(results.mainOut, statistics, comment);
             else
@@ -338,6 +438,10 @@ void print_content_properties(const database& db)
         std::cout
         << "targets              " << db.target_count() << '\n';
     }
+    if (db.alias_count() > 0) {
+        std::cout
+        << "aliases              " << db.alias_count() << '\n';
+    }
 
     if (db.feature_count() > 0) {
         auto lss = db.location_list_size_statistics();
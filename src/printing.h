@@ -71,12 +71,14 @@ void show_target_header(std::ostream&,
 
 /*************************************************************************//**
  *
- * @brief prints top classification candidates
+ * @brief prints top classification candidates;
+ *        optionally expanded to all aliases of deduplicated targets
  *
  *****************************************************************************/
 void show_candidates(std::ostream&,
                      const database&,
-                     const classification_candidates&);
+                     const classification_candidates&,
+                     bool showAliases = false);
 
 
 /*************************************************************************//**
@@ -110,6 +112,16 @@ void show_statistics(std::ostream&,
                      const std::string& prefix = "");
 
 
+/*************************************************************************//**
+ *
+ * @brief prints mapping rate (and accuracy) for each point
+ *        of a parameter sweep
+ *
+ *****************************************************************************/
+void show_sweep_results(const query_options& opt,
+                        const classification_results& results);
+
+
 /*************************************************************************//**
  *
  * @brief show summary and statistics of classification
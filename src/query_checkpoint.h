@@ -0,0 +1,204 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef RMA_QUERY_CHECKPOINT_H_
+#define RMA_QUERY_CHECKPOINT_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "classification_statistics.h"
+#include "io_error.h"
+#include "io_serialize.h"
+#include "matches_per_target.h"
+#include "querying.h"
+#include "version.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief sizes of the output files of one database
+ *
+ *****************************************************************************/
+struct query_output_positions
+{
+    std::uint64_t mainOut = 0;
+    std::uint64_t samOut = 0;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief consistent state of a query run:
+ *        all queries before 'input' have been processed and their output
+ *        has been written; everything after that is not part of the state
+ *
+ *****************************************************************************/
+struct query_checkpoint
+{
+    std::vector<std::string> infiles;
+    query_input_position input;
+
+    // one entry per database
+    std::vector<query_output_positions> outputs;
+    std::vector<mapping_statistics::counters> statistics;
+    std::vector<lookup_statistics::counters> lookups;
+    // coverage from 1st pass
+    std::vector<coverage_per_target> coverage;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief writes checkpoint to a temporary file first and then renames it,
+ *        so that the checkpoint file is always consistent
+ *
+ *****************************************************************************/
+inline void
+write_query_checkpoint(const std::string& filename, const query_checkpoint& cp)
+{
+    const auto tmpFilename = filename + ".tmp";
+    {
+        std::ofstream os{tmpFilename, std::ios::out | std::ios::binary};
+        if (!os.good()) {
+            throw file_write_error{"Could not write checkpoint file " + tmpFilename};
+        }
+
+        write_binary(os, std::uint64_t(RMA_CHECKPOINT_VERSION));
+
+        write_binary(os, std::uint64_t(cp.infiles.size()));
+        for (const auto& f : cp.infiles) write_binary(os, f);
+
+        write_binary(os, std::uint64_t(cp.input.source));
+        write_binary(os, std::int64_t(std::streamoff(cp.input.streamPos.first)));
+        write_binary(os, std::int64_t(std::streamoff(cp.input.streamPos.second)));
+        write_binary(os, std::uint64_t(cp.input.idOffset));
+        write_binary(os, std::uint64_t(cp.input.queriesRead));
+
+        write_binary(os, std::uint64_t(cp.outputs.size()));
+        for (std::size_t i = 0; i < cp.outputs.size(); ++i) {
+            write_binary(os, cp.outputs[i].mainOut);
+            write_binary(os, cp.outputs[i].samOut);
+
+            const auto& s = cp.statistics[i];
+            write_binary(os, s.totalReads);
+            write_binary(os, s.totalMatches);
+            write_binary(os, s.alignedReads);
+            write_binary(os, s.originMapped);
+            write_binary(os, s.originMappedWeighted);
+            write_binary(os, s.correctlyRejected);
+
+            write_binary(os, cp.lookups[i].performed);
+            write_binary(os, cp.lookups[i].skipped);
+
+            write_binary(os, cp.coverage[i]);
+        }
+
+        os.flush();
+        if (!os.good()) {
+            throw file_write_error{"Could not write checkpoint file " + tmpFilename};
+        }
+    }
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        throw file_write_error{"Could not write checkpoint file " + filename};
+    }
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @return false, if checkpoint file doesn't exist
+ *
+ *****************************************************************************/
+inline bool
+read_query_checkpoint(const std::string& filename, query_checkpoint& cp)
+{
+    std::ifstream is{filename, std::ios::in | std::ios::binary};
+    if (!is.good()) return false;
+
+    std::uint64_t version = 0;
+    read_binary(is, version);
+    if (version != RMA_CHECKPOINT_VERSION) {
+        throw file_read_error{"Checkpoint file " + filename + " is incompatible "
+                              "with this version of RmapAlign3N"};
+    }
+
+    std::uint64_t n = 0;
+    read_binary(is, n);
+    cp.infiles.resize(n);
+    for (auto& f : cp.infiles) read_binary(is, f);
+
+    std::uint64_t source = 0, idOffset = 0, queriesRead = 0;
+    std::int64_t pos1 = 0, pos2 = 0;
+    read_binary(is, source);
+    read_binary(is, pos1);
+    read_binary(is, pos2);
+    read_binary(is, idOffset);
+    read_binary(is, queriesRead);
+    cp.input.source = source;
+    cp.input.streamPos = {std::streamoff(pos1), std::streamoff(pos2)};
+    cp.input.idOffset = query_id(idOffset);
+    cp.input.queriesRead = queriesRead;
+
+    read_binary(is, n);
+    cp.outputs.resize(n);
+    cp.statistics.resize(n);
+    cp.lookups.resize(n);
+    cp.coverage.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        read_binary(is, cp.outputs[i].mainOut);
+        read_binary(is, cp.outputs[i].samOut);
+
+        auto& s = cp.statistics[i];
+        read_binary(is, s.totalReads);
+        read_binary(is, s.totalMatches);
+        read_binary(is, s.alignedReads);
+        read_binary(is, s.originMapped);
+        read_binary(is, s.originMappedWeighted);
+        read_binary(is, s.correctlyRejected);
+
+        read_binary(is, cp.lookups[i].performed);
+        read_binary(is, cp.lookups[i].skipped);
+
+        read_binary(is, cp.coverage[i]);
+    }
+
+    if (!is.good()) {
+        throw file_read_error{"Checkpoint file " + filename + " is corrupted"};
+    }
+    return true;
+}
+
+
+} // namespace mc
+
+
+#endif
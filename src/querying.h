@@ -23,14 +23,23 @@
 #ifndef RMA_QUERYING_H_
 #define RMA_QUERYING_H_
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
+#include <functional>
+#include <string_view>
 
 #include "database.h"
+#include "candidates.h"
+#include "classification_statistics.h"
 #include "options.h"
 #include "sequence_io.h"
 #include "cmdline_utility.h"
+#include "filesys_utility.h"
+#include "hash_int.h"
 #include "batch_processing.h"
+#include "packed_sequence.h"
+#include "read_trimming.h"
 
 //added this header because otherwise template bug appeared
 //WARNING!!! doesn't work because circular dependency???
@@ -72,23 +81,454 @@ struct sequence_query
 
 
 
+/*************************************************************************//**
+ *
+ * @brief single query with 2-bit packed read (pair) storage;
+ *        used inside query batches; characters are only unpacked
+ *        if needed for output (see lazy_sequence_query)
+ *
+ *        All data of one query lives in two buffers (arenas):
+ *        one for the packed nucleotides and ambiguity masks of both mates and
+ *        one for the characters (header + original ambiguous characters).
+ *        Since batch storage is recycled by the batch executor the buffers
+ *        only grow if a query is larger than all previous ones in the slot.
+ *
+ *****************************************************************************/
+class packed_sequence_query
+{
+public:
+    //---------------------------------------------------------------
+    /**
+     * @brief packs header & read (pair); works with any string-like
+     *        sequence type (e.g. std::string_view of external memory)
+     */
+    template<class Header, class Sequence>
+    void assign(query_id qid, const Header& header,
+                const Sequence& s1, const Sequence& s2)
+    {
+        id_ = qid;
+        chars_.assign(header);
+        headerSize_ = header.size();
+        const auto end = mate1_.pack(s1, words_, 0, chars_);
+        mate2_.pack(s2, words_, end, chars_);
+    }
+
+    //---------------------------------------------------------------
+    /**
+     * @brief reads next query and packs it directly from the input
+     */
+    query_id read_next(sequence_pair_reader& reader)
+    {
+        id_ = reader.next_header_and_packed_data(chars_, words_, mate1_, mate2_);
+        // header is followed by ambiguous characters
+        headerSize_ = mate1_.chars;
+        return id_;
+    }
+
+
+    //---------------------------------------------------------------
+    bool empty() const noexcept {
+        return headerSize_ < 1 || mate1_.first >= mate1_.last;
+    }
+
+    query_id id() const noexcept { return id_; }
+
+    std::string_view header() const noexcept {
+        return std::string_view{chars_.data(), headerSize_};
+    }
+
+    packed_sequence_view seq1() const noexcept { return mate1_.view(words_, chars_); }
+    packed_sequence_view seq2() const noexcept { return mate2_.view(words_, chars_); }
+
+
+    //---------------------------------------------------------------
+    template<class Trimmer>
+    void trim(const Trimmer& trimmer) {
+        restrict(mate1_, trimmer(seq1()));
+        restrict(mate2_, trimmer(seq2()));
+    }
+
+
+    //---------------------------------------------------------------
+    /// @return approximate number of bytes used by query
+    std::size_t memory() const noexcept {
+        return sizeof(*this) + words_.capacity() * sizeof(std::uint64_t)
+                             + chars_.capacity();
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    static void
+    restrict(packed_sequence_layout& mate, const packed_sequence_view& v) noexcept {
+        mate.first = v.first();
+        mate.last = v.last();
+    }
+
+    //---------------------------------------------------------------
+    query_id id_ = 0;
+    std::size_t headerSize_ = 0;
+    packed_sequence_layout mate1_;
+    packed_sequence_layout mate2_;
+    std::vector<std::uint64_t> words_;
+    std::string chars_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief packed query whose characters are only unpacked on first access
+ *        (alignment, SAM/BAM output); id and header are always available
+ *
+ *****************************************************************************/
+class lazy_sequence_query
+{
+public:
+    //---------------------------------------------------------------
+    /**
+     * @param buffer  receives id and header immediately and the
+     *                unpacked sequences on first call of 'unpacked'
+     */
+    lazy_sequence_query(const packed_sequence_query& packed,
+                        sequence_query& buffer)
+    :
+        packed_{packed}, buf_{buffer}
+    {
+        buf_.id = packed.id();
+        buf_.header.assign(packed.header());
+        buf_.seq1.clear();
+        buf_.seq2.clear();
+    }
+
+    lazy_sequence_query(const lazy_sequence_query&) = delete;
+    lazy_sequence_query& operator = (const lazy_sequence_query&) = delete;
+
+
+    //---------------------------------------------------------------
+    bool empty() const noexcept { return packed_.empty(); }
+
+    query_id id() const noexcept { return buf_.id; }
+
+    const std::string& header() const noexcept { return buf_.header; }
+
+    /// @return total length of both mates
+    std::size_t length() const noexcept {
+        return packed_.seq1().size() + packed_.seq2().size();
+    }
+
+
+    //---------------------------------------------------------------
+    const sequence_query& unpacked() const {
+        if (!unpacked_) {
+            packed_.seq1().unpack(buf_.seq1);
+            packed_.seq2().unpack(buf_.seq2);
+            unpacked_ = true;
+        }
+        return buf_;
+    }
+
+
+private:
+    const packed_sequence_query& packed_;
+    sequence_query& buf_;
+    mutable bool unpacked_ = false;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief maximum number of windows that a candidate range may span
+ *
+ *****************************************************************************/
+inline window_id
+max_windows_in_range(const database& db, const classification_options& opt,
+                     std::size_t queryLength)
+{
+    return window_id( 2 + (
+        std::max(queryLength, opt.insertSizeMax) /
+        db.target_sketcher().window_stride() ));
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief first finds the location lists of all query features and then
+ *        collects them from small to large until the classification
+ *        candidates can no longer change under the 'hitsMin' and
+ *        'hitsCutoff' rules
+ *
+ *        A remaining location list with n entries can add at most
+ *        min(n, W) hits to any candidate (W = 'maxWindowsInRange').
+ *        With G = sum of these bounds over all remaining lists,
+ *        H = hits of the top candidate and h = hits of the runner-up
+ *        collecting stops if
+ *          - no target can reach 'hitsMin' anymore, or
+ *          - H >= hitsMin and h + G < max(hitsMin, hitsCutoff * H).
+ *        Candidates are re-ranked at most every 'rankInterval' lists.
+ *
+ * @param locations reusable buffer for location lists
+ * @param performed number of collected location lists will be added
+ * @param skipped   number of skipped location lists will be added
+ *
+ *****************************************************************************/
+inline void
+accumulate_matches_adaptive(const database& db,
+                            const classification_options& opt,
+                            const packed_sequence_query& query,
+                            std::vector<database::feature_locations>& locations,
+                            database::matches_sorter& res,
+                            std::size_t& performed, std::size_t& skipped)
+{
+    constexpr std::size_t rankInterval = 8;
+
+    const auto s1 = query.seq1();
+    const auto s2 = query.seq2();
+
+    locations.clear();
+    const auto collect = [&] (const auto& sk) {
+        db.find_sketch_locations(sk, locations);
+    };
+    db.query_sketcher().for_each_sketch(s1.begin(), s1.end(), collect);
+    db.query_sketcher().for_each_sketch(s2.begin(), s2.end(), collect);
+
+    // small (discriminative, cheap) lists first
+    std::stable_sort(locations.begin(), locations.end(),
+        [] (database::feature_locations a, database::feature_locations b) {
+            return a->size() < b->size();
+        });
+
+    candidate_generation_rules rules;
+    rules.maxWindowsInRange = max_windows_in_range(db, opt, s1.size() + s2.size());
+    rules.maxCandidates = 2;
+
+    // max. hits that one location list can add to a candidate
+    const std::size_t maxGain = std::max(window_id(1), rules.maxWindowsInRange);
+    const auto gain_of = [&] (database::feature_locations locs) {
+        return std::min(std::size_t(locs->size()), maxGain);
+    };
+
+    std::size_t gain = 0;
+    for (auto locs : locations) gain += gain_of(locs);
+
+    const auto hitsMin = double(opt.hitsMin);
+
+    std::size_t i = 0;
+    std::size_t untilRanking = 0;
+
+    while (i < locations.size()) {
+        db.accumulate_locations(locations[i], res);
+        gain -= gain_of(locations[i]);
+        ++i;
+
+        // no target can reach 'hitsMin' anymore
+        if (double(res.size() + gain) < hitsMin) break;
+
+        // cheap test: top candidate can't have more hits than there are matches
+        if (double(gain) >= std::max(hitsMin, opt.hitsCutoff * res.size())) {
+            continue;
+        }
+
+        if (untilRanking > 0) {
+            --untilRanking;
+            continue;
+        }
+        untilRanking = rankInterval - 1;
+
+        res.sort();
+        const top_distinct_matches_in_contiguous_window_ranges top{
+            res.locations(), rules};
+
+        match_candidate::count_type first = 0;
+        match_candidate::count_type second = 0;
+        for (const auto& cand : top) {
+            if (cand.hits > first) {
+                second = first;
+                first = cand.hits;
+            } else if (cand.hits > second) {
+                second = cand.hits;
+            }
+        }
+
+        if (first >= opt.hitsMin &&
+            double(second + gain) < std::max(hitsMin, opt.hitsCutoff * first))
+        {
+            break;
+        }
+    }
+
+    performed += i;
+    skipped += locations.size() - i;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief collects sorted database matches of a query
+ *        (adaptive lookups if enabled in the classification options)
+ *
+ *****************************************************************************/
+inline void
+accumulate_query_matches(const database& db,
+                         const classification_options& opt,
+                         const packed_sequence_query& query,
+                         std::vector<database::feature_locations>& locations,
+                         database::matches_sorter& res,
+                         std::size_t& performed, std::size_t& skipped)
+{
+    res.clear();
+
+    if (opt.adaptiveLookups) {
+        accumulate_matches_adaptive(db, opt, query, locations, res,
+                                    performed, skipped);
+    }
+    else {
+        const auto s1 = query.seq1();
+        const auto s2 = query.seq2();
+        db.accumulate_matches(s1.begin(), s1.end(), res);
+        db.accumulate_matches(s2.begin(), s2.end(), res);
+    }
+    res.sort();
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief deterministic subsampling of queries;
+ *        the same query ids are selected in every run
+ *
+ *****************************************************************************/
+inline bool
+in_query_sample(query_id qid, double fraction) noexcept
+{
+    // 53 random bits -> [0,1)
+    return double(splitmix64_hash(std::uint64_t(qid)) >> 11) * 0x1.0p-53 < fraction;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief estimates the number of queries (reads or read pairs) in the
+ *        input files by reading the first queries of each sequence source
+ *        and extrapolating to the total file size
+ *
+ *****************************************************************************/
+inline std::size_t
+estimate_query_count(const std::vector<std::string>& infilenames,
+                     const query_options& opt,
+                     std::size_t probeSize = 1000)
+{
+    const auto pairing = opt.pairing;
+    const size_t stride = pairing == pairing_mode::files ? 1 : 0;
+    const std::string nofile;
+
+    const auto queryLimit = std::size_t(std::max(std::int_least64_t(0),
+                                                 opt.performance.queryLimit));
+
+    sequence_query parsed;
+    double total = 0;
+
+    for (size_t i = 0; i < infilenames.size(); i += stride+1) {
+        const auto& fname1 = infilenames[i];
+        const auto& fname2 = (pairing == pairing_mode::none)
+                             ? nofile : infilenames[i+stride];
+        try {
+            sequence_pair_reader reader{fname1, fname2};
+
+            std::size_t n = 0;
+            while (n < probeSize && reader.has_next()) {
+                reader.next_header_and_data(parsed.header, parsed.seq1, parsed.seq2);
+                ++n;
+            }
+
+            double count = n;
+            if (reader.has_next()) {
+                // extrapolate from bytes consumed so far
+                const auto pos = std::streamoff(reader.tell().first);
+                if (pos > 0) count = n * double(file_size(fname1)) / double(pos);
+            }
+            total += std::min(count, double(queryLimit));
+        }
+        catch(std::exception&) {}
+    }
+
+    return std::size_t(total);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief position in the input: sequence source (index of its first file),
+ *        stream positions within that source and query id offset
+ *
+ *****************************************************************************/
+struct query_input_position
+{
+    std::size_t source = 0;
+    sequence_pair_reader::stream_positions streamPos {0,0};
+    query_id idOffset = 0;
+    // queries read from current source (counted towards query limit)
+    std::size_t queriesRead = 0;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief periodic checkpoints during querying;
+ *        'save' is called after all queries read so far have been
+ *        processed and finalized
+ *
+ *****************************************************************************/
+struct query_checkpointing
+{
+    // number of queries between checkpoints; 0 : no checkpoints
+    std::size_t interval = 0;
+    // input position to start/resume from
+    query_input_position start;
+
+    std::function<void(const query_input_position&)> save;
+
+    bool active() const noexcept { return interval > 0 && bool(save); }
+};
+
+
+
  /*************************************************************************//**
  *
- * @brief queries database with batches of reads from ONE sequence source (pair)
- *        produces batch buffers with one match list per sequence
+ * @brief queries one or more databases with batches of reads
+ *        from ONE sequence source (pair);
+ *        each read is parsed and trimmed only once and then looked up
+ *        in all databases (in the given order);
+ *        produces batch buffers with one match list per sequence and database;
+ *        reads are trimmed (see read_trimming_options) before sketching
  *
  * @tparam BufferSource     returns a per-batch buffer object
  *
- * @tparam BufferUpdate     takes database matches of one query and a buffer;
+ * @tparam BufferUpdate     takes a buffer, database index, query
+ *                          (lazy_sequence_query) and database matches
+ *                          of one query;
  *                          must be thread-safe (only const operations on DB!)
  *
  * @tparam BufferSink       recieves buffer after batch is finished
  *
- * @tparam InfoCallback     prints messages
+ * @tparam ErrorHandler     handles exceptions
  *
- * @tparam ProgressHandler  prints progress messages
+ * @param  lookups          counts feature lookups per database
+ *                          (only in adaptive mode)
  *
- * @tparam ErrorHandler     handles exceptions
+ * @param  start            position to start reading from
+ *
+ * @param  checkpoints      periodic checkpoints (all queries read before
+ *                          a checkpoint are finalized when it is saved)
+ *
+ * @param  batching         records batch settings (if not null)
  *
  *****************************************************************************/
 template<
@@ -97,57 +537,116 @@ template<
 >
 query_id query_batched(
     const std::string& filename1, const std::string& filename2,
-    const database& db, const performance_tuning_options& opt,
-    query_id idOffset,
+    const std::vector<const database*>& dbs, const query_options& opt,
+    const std::vector<lookup_statistics*>& lookups,
+    const query_input_position& start,
     BufferSource&& getBuffer, BufferUpdate&& update, BufferSink&& finalize,
-    ErrorHandler&& handleErrors)
+    ErrorHandler&& handleErrors,
+    const query_checkpointing& checkpoints = query_checkpointing{},
+    batch_statistics* batching = nullptr)
 {
-    if (opt.queryLimit < 1) return idOffset;
-    auto queryLimit = size_t(opt.queryLimit > 0 ? opt.queryLimit : std::numeric_limits<size_t>::max());
+    const auto& perf = opt.performance;
+
+    query_id idOffset = start.idOffset;
+
+    if (perf.queryLimit < 1) return idOffset;
+    auto queryLimit = size_t(perf.queryLimit > 0 ? perf.queryLimit : std::numeric_limits<size_t>::max());
+    if (start.queriesRead >= queryLimit) return idOffset;
+    queryLimit -= start.queriesRead;
+
+    const read_trimmer trim{opt.trimming};
 
     std::mutex finalizeMtx;
 
     // get executor that runs classification in batches
     batch_processing_options execOpt;
-    execOpt.concurrency(opt.numThreads - 1);
-    execOpt.batch_size(opt.batchSize);
-    execOpt.queue_size(opt.numThreads > 1 ? opt.numThreads + 4 : 0);
+    execOpt.concurrency(perf.numThreads - 1);
+    execOpt.shared_threads(perf.sharedThreads);
+    execOpt.batch_size(perf.batchSize);
+    const int maxThreads = perf.sharedThreads
+        ? std::max(perf.numThreads, perf.sharedThreads->capacity() + 1)
+        : perf.numThreads;
+    execOpt.queue_size(maxThreads > 1 ? maxThreads + 4 : 0);
+    execOpt.auto_tune(perf.autoTuneBatches);
+    execOpt.memory_limit(perf.batchMemoryLimit << 20);
     execOpt.on_error(handleErrors);
 
-    batch_executor<sequence_query> executor {
+    work_stealing_executor<packed_sequence_query> executor {
         execOpt,
-        // classifies a batch of input queries
-        [&](int, std::vector<sequence_query>& batch) {
+        // classifies (part of) a batch of input queries
+        [&](int, std::vector<packed_sequence_query>& batch,
+            std::size_t first, std::size_t last)
+        {
             auto resultsBuffer = getBuffer();
             database::matches_sorter targetMatches;
+            sequence_query unpacked;
+            std::vector<database::feature_locations> locations;
+            std::vector<std::size_t> performed(dbs.size(), 0);
+            std::vector<std::size_t> skipped(dbs.size(), 0);
+
+            for (std::size_t q = first; q < last; ++q) {
+                auto& seq = batch[q];
+                if (trim) seq.trim(trim);
+
+                const lazy_sequence_query query{seq, unpacked};
+
+                for (std::size_t i = 0; i < dbs.size(); ++i) {
+                    const auto& db = *dbs[i];
 
-            for (auto& seq : batch) {
-                targetMatches.clear();
+                    accumulate_query_matches(db, opt.classify, seq, locations,
+                                             targetMatches,
+                                             performed[i], skipped[i]);
 
-                db.accumulate_matches(seq.seq1, targetMatches);
-                db.accumulate_matches(seq.seq2, targetMatches);
-                targetMatches.sort();
+                    update(resultsBuffer, i, query, targetMatches.locations());
+                }
+            }
 
-                update(resultsBuffer, seq, targetMatches.locations());
+            if (opt.classify.adaptiveLookups) {
+                for (std::size_t i = 0; i < dbs.size() && i < lookups.size(); ++i) {
+                    lookups[i]->add(performed[i], skipped[i]);
+                }
             }
 
             std::lock_guard<std::mutex> lock(finalizeMtx);
             finalize(std::move(resultsBuffer));
         }};
 
+    executor.item_memory([] (const packed_sequence_query& q) { return q.memory(); });
+
     // read sequences from file
     try {
         sequence_pair_reader reader{filename1, filename2};
+        if (start.queriesRead > 0) reader.seek(start.streamPos);
         reader.index_offset(idOffset);
 
+        auto queriesRead = start.queriesRead;
+        std::size_t sinceCheckpoint = 0;
+
         while (reader.has_next()) {
             if (queryLimit < 1) break;
 
-            // get (ref to) next query sequence storage and fill it
-            auto& query = executor.next_item();
-            query.id = reader.next_header_and_data(query.header, query.seq1, query.seq2);
+            if (checkpoints.active() && sinceCheckpoint >= checkpoints.interval) {
+                // everything read so far must be written
+                executor.wait_until_idle();
+                checkpoints.save(query_input_position{
+                    start.source, reader.tell(), reader.index(), queriesRead});
+                sinceCheckpoint = 0;
+            }
 
             --queryLimit;
+            ++queriesRead;
+            ++sinceCheckpoint;
+
+            // id of next query
+            if (perf.queryFraction < 1.0 &&
+                !in_query_sample(reader.index() + 1, perf.queryFraction))
+            {
+                reader.skip(1);
+                continue;
+            }
+
+            // get (ref to) next query storage and fill it directly from input
+            executor.next_item().read_next(reader);
         }
 
         idOffset = reader.index();
@@ -156,6 +655,10 @@ query_id query_batched(
         handleErrors(e);
     }
 
+    if (batching) {
+        batching->record(executor.batch_size(), executor.batches_in_flight());
+    }
+
     return idOffset;
 }
 
@@ -164,11 +667,14 @@ query_id query_batched(
 
  /*************************************************************************//**
  *
- * @brief queries database with batches of reads from multiple sequence sources
+ * @brief queries one or more databases with batches of reads
+ *        from multiple sequence sources
  *
  * @tparam BufferSource     returns a per-batch buffer object
  *
- * @tparam BufferUpdate     takes database matches of one query and a buffer;
+ * @tparam BufferUpdate     takes a buffer, database index, query
+ *                          (lazy_sequence_query) and database matches
+ *                          of one query;
  *                          must be thread-safe (only const operations on DB!)
  *
  * @tparam BufferSink       recieves buffer after batch is finished
@@ -179,30 +685,37 @@ query_id query_batched(
  *
  * @tparam ErrorHandler     handles exceptions
  *
+ * @param  checkpoints      start position & periodic checkpoints
+ *
+ * @param  batching         records batch settings (if not null)
+ *
  *****************************************************************************/
 template<
     class BufferSource, class BufferUpdate, class BufferSink,
     class InfoCallback, class ProgressHandler, class ErrorHandler
 >
-void query_database(
+void query_databases(
     const std::vector<std::string>& infilenames,
-    const database& db,
-    pairing_mode pairing,
-    const performance_tuning_options& opt,
+    const std::vector<const database*>& dbs,
+    const query_options& opt,
+    const std::vector<lookup_statistics*>& lookups,
     BufferSource&& bufsrc, BufferUpdate&& bufupdate, BufferSink&& bufsink,
     InfoCallback&& showInfo, ProgressHandler&& showProgress,
-    ErrorHandler&& errorHandler)
+    ErrorHandler&& errorHandler,
+    const query_checkpointing& checkpoints,
+    batch_statistics* batching)
 {
+    const auto pairing = opt.pairing;
     const size_t stride = pairing == pairing_mode::files ? 1 : 0;
     const std::string nofile;
-    query_id queryIdOffset = 0;
+    query_id queryIdOffset = checkpoints.start.idOffset;
 
     // input filenames passed to sequence reader depend on pairing mode:
     // none     -> infiles[i], ""
     // sequence -> infiles[i], infiles[i]
     // files    -> infiles[i], infiles[i+1]
 
-    for (size_t i = 0; i < infilenames.size(); i += stride+1) {
+    for (size_t i = checkpoints.start.source; i < infilenames.size(); i += stride+1) {
         //pair up reads from two consecutive files in the list
         const auto& fname1 = infilenames[i];
 
@@ -216,16 +729,72 @@ void query_database(
         }
         showProgress(infilenames.size() > 1 ? i/float(infilenames.size()) : -1);
 
-        queryIdOffset = query_batched(fname1, fname2, db, opt, queryIdOffset,
+        auto start = query_input_position{i, {0,0}, queryIdOffset, 0};
+        if (i == checkpoints.start.source) start = checkpoints.start;
+
+        queryIdOffset = query_batched(fname1, fname2, dbs, opt, lookups, start,
                                      std::forward<BufferSource>(bufsrc),
                                      std::forward<BufferUpdate>(bufupdate),
                                      std::forward<BufferSink>(bufsink),
-                                     errorHandler);
+                                     errorHandler, checkpoints, batching);
+
+        // source finished => continue with next one
+        if (checkpoints.active() && i + stride + 1 < infilenames.size()) {
+            checkpoints.save(query_input_position{i + stride + 1, {0,0}, queryIdOffset, 0});
+        }
     }
 }
 
 
 
+/*************************************************************************//**
+ *
+ * @brief queries one or more databases
+ *
+ * @tparam BufferSource  returns a per-batch buffer object
+ *
+ * @tparam BufferUpdate  takes a buffer, database index, query
+ *                       (lazy_sequence_query) and database matches
+ *                       of one query;
+ *                       must be thread-safe (only const operations on DB!)
+ *
+ * @tparam BufferSink    recieves buffer after batch is finished
+ *
+ * @tparam InfoCallback  prints status messages
+ *
+ * @param  checkpoints   start position & periodic checkpoints
+ *
+ * @param  batching      records batch settings (if not null)
+ *
+ *****************************************************************************/
+template<
+    class BufferSource, class BufferUpdate, class BufferSink, class InfoCallback
+>
+void query_databases(
+    const std::vector<std::string>& infilenames,
+    const std::vector<const database*>& dbs,
+    const query_options& opt,
+    const std::vector<lookup_statistics*>& lookups,
+    BufferSource&& bufsrc, BufferUpdate&& bufupdate, BufferSink&& bufsink,
+    InfoCallback&& showInfo,
+    const query_checkpointing& checkpoints = query_checkpointing{},
+    batch_statistics* batching = nullptr)
+{
+    query_databases(infilenames, dbs, opt, lookups,
+       std::forward<BufferSource>(bufsrc),
+       std::forward<BufferUpdate>(bufupdate),
+       std::forward<BufferSink>(bufsink),
+       std::forward<InfoCallback>(showInfo),
+       [&] (float p) {
+           if (opt.output.showProgress) show_progress_indicator(std::cerr, p);
+       },
+       [] (std::exception& e) { std::cerr << "FAIL: " << e.what() << '\n'; },
+       checkpoints, batching
+    );
+}
+
+
+
 /*************************************************************************//**
  *
  * @brief queries database
@@ -246,19 +815,20 @@ template<
 void query_database(
     const std::vector<std::string>& infilenames,
     const database& db,
-    pairing_mode pairing,
-    const performance_tuning_options& opt,
+    const query_options& opt,
+    lookup_statistics& lookups,
     BufferSource&& bufsrc, BufferUpdate&& bufupdate, BufferSink&& bufsink,
     InfoCallback&& showInfo)
 {
-    query_database(infilenames, db, pairing, opt,
+    query_databases(infilenames, {&db}, opt, {&lookups},
        std::forward<BufferSource>(bufsrc),
-       std::forward<BufferUpdate>(bufupdate),
+       [&] (auto& buf, std::size_t, const lazy_sequence_query& query,
+            const auto& allhits)
+       {
+           bufupdate(buf, query, allhits);
+       },
        std::forward<BufferSink>(bufsink),
-       std::forward<InfoCallback>(showInfo),
-       [] (float p) { show_progress_indicator(std::cerr, p); },
-       [] (std::exception& e) { std::cerr << "FAIL: " << e.what() << '\n'; }
-    );
+       std::forward<InfoCallback>(showInfo));
 }
 
 
@@ -0,0 +1,274 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "read_mapper.h"
+#include "classification.h"
+#include "classify_common.h"
+#include "alignment.h"
+
+
+namespace mc {
+
+
+//-------------------------------------------------------------------
+read_mapper::read_mapper(const database& db, query_options opt):
+    db_(db), opt_(std::move(opt)), coverage_{}
+{
+    adapt_options_to_database(opt_.classify, db_);
+}
+
+
+
+//-------------------------------------------------------------------
+void read_mapper::coverage(coverage_per_target cov)
+{
+    if (cov.size() > 0 && cov.size() != db_.target_count()) {
+        throw std::invalid_argument{
+            "Coverage table doesn't match the number of database targets!"};
+    }
+    coverage_ = std::move(cov);
+}
+
+
+
+//-------------------------------------------------------------------
+void read_mapper::map_packed(context& ctx) const
+{
+    auto& res = ctx.result_;
+    res.alignments.clear();
+
+    // same preprocessing as in query mode: trim;
+    // characters are only unpacked for alignment
+    if (ctx.trim_) ctx.packed_.trim(ctx.trim_);
+
+    const lazy_sequence_query query{ctx.packed_, ctx.query_};
+
+    if (ctx.packed_.seq1().empty()) {
+        res.candidates = classification_candidates{};
+        return;
+    }
+
+    accumulate_query_matches(db_, opt_.classify, ctx.packed_, ctx.locations_,
+                             ctx.matches_, ctx.performed_, ctx.skipped_);
+
+    res.candidates = make_classification_candidates(
+                         db_, opt_.classify, query, ctx.matches_.locations());
+
+    hits_cutoff_filter(opt_.classify, res.candidates);
+
+    if (has_coverage()) {
+        coverage_filter(opt_.classify, res.candidates, coverage_);
+    }
+
+    if (!opt_.classify.align) return;
+
+    // removes unalignable candidates
+    std::vector<edlib_alignment_pair> alns;
+    const auto primary = make_candidate_alignments(
+                             db_, opt_.classify, query.unpacked(),
+                             res.candidates, alns);
+
+    const auto mate = [] (const edlib_alignment& a) {
+        mate_alignment m;
+        m.aligned = a.aligned();
+        m.reverse = a.orientation() == edlib_alignment::status::REVERSE;
+        m.score = a.score();
+        if (m.aligned) {
+            m.start = a.start();
+            m.end = a.end();
+            if (a.cigar()) m.cigar = a.cigar();
+        }
+        return m;
+    };
+
+    for (const auto& aln : alns) {
+        read_alignment ra;
+        ra.tgt = aln.tgt();
+        ra.score = aln.score();
+        ra.mate1 = mate(aln.first);
+        ra.mate2 = mate(aln.second);
+        res.alignments.push_back(std::move(ra));
+    }
+
+    if (!res.alignments.empty()) res.alignments[primary].primary = true;
+}
+
+
+
+//-------------------------------------------------------------------
+const read_mapping&
+read_mapper::map(context& ctx, query_id qid, std::string_view header,
+                 std::string_view seq1, std::string_view seq2) const
+{
+    ctx.packed_.assign(qid, header, seq1, seq2);
+    map_packed(ctx);
+    return ctx.result_;
+}
+
+
+
+//-------------------------------------------------------------------
+void read_mapper::map(const sequence_query& query,
+                      const callback& consume) const
+{
+    context ctx{*this};
+    consume(query, map(ctx, query.id, query.header, query.seq1, query.seq2));
+}
+
+
+
+//-------------------------------------------------------------------
+read_mapping read_mapper::map(const sequence_query& query) const
+{
+    context ctx{*this};
+    return map(ctx, query.id, query.header, query.seq1, query.seq2);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief runs 'consume(context&, query)' for each query and
+ *        'finish(context&)' once per thread after its last query;
+ *        threads pull small chunks of queries from a shared index;
+ *        the first exception thrown by any thread is rethrown
+ *
+ *****************************************************************************/
+template<class Consumer, class Finalizer>
+void read_mapper::for_each_in_parallel(const sequence_query* first,
+                                       std::size_t count,
+                                       Consumer&& consume,
+                                       Finalizer&& finish) const
+{
+    if (count < 1) return;
+
+    constexpr std::size_t chunkSize = 64;
+
+    const auto numThreads = std::size_t(std::max(1, std::min(
+        opt_.performance.numThreads, int((count + chunkSize - 1) / chunkSize))));
+
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr error;
+    std::mutex errorMtx;
+
+    const auto job = [&] {
+        try {
+            context ctx{*this};
+            for (auto beg = next.fetch_add(chunkSize); beg < count;
+                 beg = next.fetch_add(chunkSize))
+            {
+                const auto end = std::min(count, beg + chunkSize);
+                for (auto i = beg; i < end; ++i) {
+                    consume(ctx, first[i]);
+                }
+            }
+            finish(ctx);
+        }
+        catch(...) {
+            // stop all threads
+            next = count;
+            std::lock_guard<std::mutex> lock(errorMtx);
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < numThreads; ++i) {
+        threads.emplace_back(job);
+    }
+    job();
+    for (auto& t : threads) t.join();
+
+    if (error) std::rethrow_exception(error);
+}
+
+
+
+//-------------------------------------------------------------------
+void read_mapper::map(const sequence_query* first, std::size_t count,
+                      const callback& consume) const
+{
+    for_each_in_parallel(first, count,
+        [&] (context& ctx, const sequence_query& query) {
+            consume(query, map(ctx, query.id, query.header,
+                               query.seq1, query.seq2));
+        },
+        [] (context&) {});
+}
+
+
+
+//-------------------------------------------------------------------
+coverage_per_target
+read_mapper::estimate_coverage(const sequence_query* first,
+                               std::size_t count) const
+{
+    // coverage is always estimated without coverage filter
+    read_mapper estimator{db_, opt_};
+    estimator.opt_.classify.align = false;
+
+    matches_per_target_light coverage;
+    std::mutex mergeMtx;
+
+    estimator.for_each_in_parallel(first, count,
+        [&] (context& ctx, const sequence_query& query) {
+            const auto& res = estimator.map(ctx, query.id, query.header,
+                                            query.seq1, query.seq2);
+            for (const auto& cand : res.candidates) {
+                ctx.coverage_.insert(ctx.matches_.locations(), cand,
+                                     opt_.classify.covFill);
+            }
+        },
+        [&] (context& ctx) {
+            std::lock_guard<std::mutex> lock(mergeMtx);
+            coverage.merge(std::move(ctx.coverage_));
+        });
+
+    return coverage_per_target{db_, coverage};
+}
+
+
+
+//-------------------------------------------------------------------
+database
+make_mapping_database(const std::string& filename, const query_options& opt)
+{
+    const bool targets = opt.classify.align || opt.dbconfig.rereadTargets;
+
+    auto db = make_database(filename, targets ? database::scope::everything
+                                              : database::scope::sketches,
+                            info_level::silent);
+
+    if (opt.dbconfig.maxLocationsPerFeature > 1) {
+        db.max_locations_per_feature(opt.dbconfig.maxLocationsPerFeature);
+    }
+    return db;
+}
+
+
+} // namespace mc
@@ -0,0 +1,251 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+/*************************************************************************//**
+ *
+ * @file contains the in-process read mapping API
+ *       (part of the embeddable library 'librmapalign3n')
+ *
+ *****************************************************************************/
+#ifndef RMA_READ_MAPPER_H_
+#define RMA_READ_MAPPER_H_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "config.h"
+#include "database.h"
+#include "options.h"
+#include "querying.h"
+#include "matches_per_target.h"
+#include "read_trimming.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief alignment of one read (mate) to a target
+ *
+ *****************************************************************************/
+struct mate_alignment
+{
+    bool aligned = false;
+    bool reverse = false;      // reverse complement of read aligned
+    int score = 0;             // edit distance
+    int start = 0;             // 0-based, on target
+    int end = 0;               // 0-based, inclusive
+    std::string cigar;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief alignment of one read (pair) to a mapping candidate
+ *
+ *****************************************************************************/
+struct read_alignment
+{
+    target_id tgt = 0;
+    bool primary = false;
+    int score = 0;             // edit distance of both mates
+    mate_alignment mate1;
+    mate_alignment mate2;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief mapping result of one query
+ *
+ *        If alignment is enabled ('classify.align') candidates that could
+ *        not be aligned are removed and there is one alignment per candidate
+ *        (same order).
+ *
+ *****************************************************************************/
+struct read_mapping
+{
+    classification_candidates candidates;
+    std::vector<read_alignment> alignments;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief maps in-memory reads to the targets of a database
+ *
+ *        The database is only accessed through const member functions,
+ *        so any number of mappers and threads can share the same database.
+ *        All mapping functions are const and thread-safe.
+ *
+ *        Queries are processed exactly like in query mode:
+ *        read trimming, (adaptive) feature lookups, candidate generation,
+ *        'hitsMin' / 'hitsCutoff' filtering, optional coverage filtering
+ *        and optional edlib alignment.
+ *        Alignment requires a database that was read with
+ *        database::scope::everything (see 'make_mapping_database').
+ *
+ *****************************************************************************/
+class read_mapper
+{
+public:
+    using callback = std::function<void(const sequence_query&, const read_mapping&)>;
+
+
+    //---------------------------------------------------------------
+    /**
+     * @param db   must outlive the mapper
+     * @param opt  query options; hit threshold is deduced from the
+     *             database if not set (same as in query mode)
+     */
+    explicit
+    read_mapper(const database& db, query_options opt = query_options{});
+
+
+    //---------------------------------------------------------------
+    const database& db() const noexcept { return db_; }
+
+    const query_options& options() const noexcept { return opt_; }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief maps one query; calls 'consume' exactly once
+     */
+    void map(const sequence_query&, const callback& consume) const;
+
+    /**
+     * @brief maps one query; returns result
+     */
+    read_mapping map(const sequence_query&) const;
+
+    /**
+     * @brief maps a batch of queries with 'performance.numThreads' threads;
+     *        'consume' is called once per query, possibly concurrently
+     *        and in any order; returns after all queries are processed
+     */
+    void map(const sequence_query* first, std::size_t count,
+             const callback& consume) const;
+
+    void map(const std::vector<sequence_query>& batch,
+             const callback& consume) const
+    {
+        map(batch.data(), batch.size(), consume);
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief estimates target coverage from a (representative) batch
+     *        of queries; corresponds to the 1st pass of query mode
+     */
+    coverage_per_target
+    estimate_coverage(const sequence_query* first, std::size_t count) const;
+
+    coverage_per_target
+    estimate_coverage(const std::vector<sequence_query>& batch) const {
+        return estimate_coverage(batch.data(), batch.size());
+    }
+
+    /**
+     * @brief enables coverage filtering ('classify.covMin');
+     *        must not be called concurrently with mapping functions
+     */
+    void coverage(coverage_per_target);
+
+    bool has_coverage() const noexcept { return coverage_.size() > 0; }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief reusable lookup & unpacking buffers;
+     *        one context must only be used by one thread at a time
+     */
+    class context
+    {
+        friend class read_mapper;
+
+    public:
+        explicit
+        context(const read_mapper& mapper): trim_{mapper.options().trimming} {}
+
+        /// @return result of last mapping with this context
+        const read_mapping& result() const noexcept { return result_; }
+
+    private:
+        read_trimmer trim_;
+        packed_sequence_query packed_;
+        sequence_query query_;
+        std::vector<database::feature_locations> locations_;
+        database::matches_sorter matches_;
+        std::size_t performed_ = 0;
+        std::size_t skipped_ = 0;
+        read_mapping result_;
+        matches_per_target_light coverage_;
+    };
+
+    /**
+     * @brief maps one query using the buffers of a context;
+     *        sequences are packed directly from the given memory;
+     *        returned result is valid until the next call with 'ctx'
+     */
+    const read_mapping&
+    map(context& ctx, query_id qid, std::string_view header,
+        std::string_view seq1, std::string_view seq2 = {}) const;
+
+
+private:
+    //---------------------------------------------------------------
+    void map_packed(context&) const;
+
+    template<class Consumer, class Finalizer>
+    void for_each_in_parallel(const sequence_query*, std::size_t,
+                              Consumer&&, Finalizer&&) const;
+
+    //---------------------------------------------------------------
+    const database& db_;
+    query_options opt_;
+    coverage_per_target coverage_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief reads a database for use with a read_mapper;
+ *        target sequences are only loaded if needed for alignment
+ *        or if requested by the database options in 'opt'
+ *
+ *****************************************************************************/
+database
+make_mapping_database(const std::string& filename, const query_options& opt);
+
+
+} // namespace mc
+
+#endif
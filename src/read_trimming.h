@@ -0,0 +1,211 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef RMA_READ_TRIMMING_H_
+#define RMA_READ_TRIMMING_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "options.h"
+#include "packed_sequence.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief removes adapters, poly-A/G tails and a fixed number of bases
+ *        from the ends of 2-bit packed reads
+ *
+ *        Adapters are matched against the 3' end of a read.
+ *        Partial adapter occurrences at the very end of a read
+ *        are detected if they are at least 'adapterMinOverlap' long.
+ *        Everything from the leftmost matching position on is removed.
+ *        'N' in adapters matches any read nucleotide,
+ *        ambiguous read positions never match.
+ *
+ *        Adapter matching compares 32 nucleotides at once by
+ *        XOR-ing the packed 2-bit codes and counting mismatching code pairs.
+ *
+ *****************************************************************************/
+class read_trimmer
+{
+    using size_type = packed_sequence_view::size_type;
+
+    struct packed_adapter {
+        size_type size = 0;
+        std::vector<std::uint64_t> codes;
+        std::vector<std::uint64_t> wildcards;  // mismatch mask per 32 positions
+    };
+
+public:
+    //---------------------------------------------------------------
+    explicit
+    read_trimmer(const read_trimming_options& opt):
+        adapters_{}, minOverlap_{size_type(std::max(1, opt.adapterMinOverlap))},
+        maxErrorRate_{std::max(0.0, opt.adapterMaxErrorRate)},
+        polyAmin_{size_type(std::max(0, opt.polyAmin))},
+        polyGmin_{size_type(std::max(0, opt.polyGmin))},
+        clip5_{size_type(std::max(0, opt.clip5))},
+        clip3_{size_type(std::max(0, opt.clip3))}
+    {
+        for (const auto& a : opt.adapters) {
+            if (!a.empty()) adapters_.push_back(make_packed_adapter(a));
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    bool active() const noexcept {
+        return !adapters_.empty() || polyAmin_ > 0 || polyGmin_ > 0 ||
+               clip5_ > 0 || clip3_ > 0;
+    }
+
+    explicit operator bool() const noexcept { return active(); }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @return trimmed (sub-)view of read
+     */
+    packed_sequence_view
+    operator () (const packed_sequence_view& read) const noexcept
+    {
+        if (read.empty()) return read;
+
+        auto first = read.first();
+        auto last = read.last();
+
+        for (const auto& adapter : adapters_) {
+            last = adapter_position(read.subview(first, last), adapter);
+        }
+
+        if (polyAmin_ > 0) last = poly_tail_position(read.subview(first,last), 0, polyAmin_);
+        if (polyGmin_ > 0) last = poly_tail_position(read.subview(first,last), 2, polyGmin_);
+
+        last  = (last - first) > clip3_ ? last - clip3_ : first;
+        first = (last - first) > clip5_ ? first + clip5_ : last;
+
+        return read.subview(first, last);
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    static packed_adapter
+    make_packed_adapter(const std::string& seq)
+    {
+        packed_adapter a;
+        a.size = seq.size();
+        a.codes.resize((a.size + 31) / 32, 0);
+        a.wildcards.resize(a.codes.size(), 0);
+
+        for (size_type i = 0; i < a.size; ++i) {
+            const auto c = nucleotide_code(seq[i]);
+            const auto s = (i & 31) << 1;
+            if (c < 4) {
+                a.codes[i >> 5] |= std::uint64_t(c) << s;
+            } else {
+                a.wildcards[i >> 5] |= std::uint64_t(1) << s;
+            }
+        }
+        return a;
+    }
+
+
+    //---------------------------------------------------------------
+    /// @return start position of leftmost adapter occurrence or end of read
+    size_type
+    adapter_position(const packed_sequence_view& read,
+                     const packed_adapter& adapter) const noexcept
+    {
+        constexpr std::uint64_t even = 0x5555555555555555ull;
+
+        const auto n = read.size();
+        if (n < minOverlap_) return read.last();
+
+        const auto last = n - minOverlap_;
+        for (size_type p = 0; p <= last; ++p) {
+            const auto len = std::min(adapter.size, n - p);
+            const auto maxErrors = size_type(len * maxErrorRate_);
+            const auto pos = read.first() + p;
+
+            size_type mm = 0;
+            for (size_type j = 0; j < len && mm <= maxErrors; j += 32) {
+                const auto d = read.codes_from(pos + j) ^ adapter.codes[j >> 5];
+                auto x = ((d | (d >> 1)) & even)
+                       | spread_bits_2(read.ambiguity_from(pos + j));
+                x &= ~adapter.wildcards[j >> 5];
+                if (len - j < 32) x &= (std::uint64_t(1) << ((len - j) << 1)) - 1;
+                mm += __builtin_popcountll(x);
+            }
+            if (mm <= maxErrors) return pos;
+        }
+        return read.last();
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @return start position of poly-<code> tail or end of read
+     *         each match scores +1, each mismatch -2;
+     *         the tail starts where the score is maximal
+     */
+    static size_type
+    poly_tail_position(const packed_sequence_view& read, std::uint8_t code,
+                       size_type minLen) noexcept
+    {
+        auto cut = read.last();
+        long score = 0;
+        long best = 0;
+
+        for (auto i = read.last(); i > read.first(); --i) {
+            const bool match = !read.ambiguous_at(i-1) && read.code_at(i-1) == code;
+            score += match ? 1 : -2;
+            if (score > best) {
+                best = score;
+                cut = i-1;
+            }
+        }
+        return (read.last() - cut) >= minLen ? cut : read.last();
+    }
+
+
+    //---------------------------------------------------------------
+    std::vector<packed_adapter> adapters_;
+    size_type minOverlap_;
+    double maxErrorRate_;
+    size_type polyAmin_;
+    size_type polyGmin_;
+    size_type clip5_;
+    size_type clip3_;
+};
+
+
+} // namespace mc
+
+
+#endif
@@ -124,6 +124,27 @@ sequence_reader::next_header_and_data(sequence::header_type& header,
 
 
 
+//-------------------------------------------------------------------
+sequence_reader::index_type
+sequence_reader::next_header_and_packed_data(header_type* header,
+                                             packed_sequence_layout& data,
+                                             std::vector<std::uint64_t>& words,
+                                             std::size_t offset,
+                                             std::string& ambigChars)
+{
+    if (!has_next()) {
+        if (header) header->clear();
+        data.pack(data_type{}, words, offset, ambigChars);
+        return index();
+    }
+
+    ++index_;
+    read_next_packed(header, data, words, offset, ambigChars);
+    return index_;
+}
+
+
+
 //-------------------------------------------------------------------
 void sequence_reader::skip(index_type skip)
 {
@@ -209,6 +230,58 @@ void fasta_reader::read_next(header_type* header, data_type* data, qualities_typ
 
 
 
+//-------------------------------------------------------------------
+void fasta_reader::read_next_packed(header_type* header,
+                                    packed_sequence_layout& data,
+                                    std::vector<std::uint64_t>& words,
+                                    std::size_t offset,
+                                    std::string& ambigChars)
+{
+    if (linebuffer_.empty()) {
+        getline(file_, linebuffer_);
+    }
+    pos_ += linebuffer_.size() + 1;
+
+    if (linebuffer_[0] != '>') {
+        throw io_format_error{"malformed fasta file - expected header char > not found"};
+    }
+
+    if (header) header->assign(linebuffer_, 1, std::string::npos);
+
+    // next header stays in the stream
+    linebuffer_.clear();
+
+    // sequence lines are packed directly from the stream buffer
+    auto& buf = *file_.rdbuf();
+    bool lineStart = true;
+    data.pack_from([&] () -> int {
+        for (;;) {
+            const auto c = buf.sgetc();
+            if (c == std::char_traits<char>::eof()) {
+                file_.setstate(std::ios::eofbit);
+                return -1;
+            }
+            if (lineStart && c == '>') return -1;
+            buf.sbumpc();
+            pos_ += 1;
+            lineStart = (c == '\n');
+            if (!lineStart) return c;
+        }
+    }, words, offset, ambigChars, ambigPos_);
+
+    if (data.length < 1) {
+        throw io_format_error{"malformed fasta file - zero-length sequence"
+                              + (header ? *header : header_type{""})};
+    }
+
+    if (!file_.good()) {
+        pos_ = -1;
+        invalidate();
+    }
+}
+
+
+
 //-------------------------------------------------------------------
 void fasta_reader::skip_next()
 {
@@ -351,6 +424,63 @@ void fastq_reader::read_next(header_type* header, data_type* data,
 
 
 
+//-------------------------------------------------------------------
+void fastq_reader::read_next_packed(header_type* header,
+                                    packed_sequence_layout& data,
+                                    std::vector<std::uint64_t>& words,
+                                    std::size_t offset,
+                                    std::string& ambigChars)
+{
+    // 1st line (data header)
+    getline(file_, linebuffer_);
+
+    if (linebuffer_.empty()) {
+        pos_ = -1;
+        invalidate();
+        if (header) header->clear();
+        data.pack(linebuffer_, words, offset, ambigChars);
+        return;
+    }
+
+    pos_ += linebuffer_.size() + 1;
+
+    if (linebuffer_[0] != '@') {
+        if (linebuffer_[0] != '\r') {
+            throw io_format_error{"malformed fastq file - sequence header: "  + linebuffer_};
+        }
+        invalidate();
+        data.pack(data_type{}, words, offset, ambigChars);
+        return;
+    }
+
+    if (header) header->assign(linebuffer_, 1, std::string::npos);
+
+    // 2nd line (sequence data) is packed directly from the stream buffer
+    auto& buf = *file_.rdbuf();
+    data.pack_from([&] () -> int {
+        const auto c = buf.sbumpc();
+        if (c == std::char_traits<char>::eof()) {
+            file_.setstate(std::ios::eofbit);
+            return -1;
+        }
+        pos_ += 1;
+        return c != '\n' ? c : -1;
+    }, words, offset, ambigChars, ambigPos_);
+
+    // 3rd (qualities header) + 4th line (qualities)
+    file_.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    pos_ += file_.gcount();
+    file_.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    pos_ += file_.gcount();
+
+    if (!file_.good()) {
+        pos_ = -1;
+        invalidate();
+    }
+}
+
+
+
 //-------------------------------------------------------------------
 void fastq_reader::skip_next()
 {
@@ -547,6 +677,41 @@ sequence_pair_reader::next_header_and_data(sequence::header_type& header1,
 
 
 
+//-------------------------------------------------------------------
+sequence_pair_reader::index_type
+sequence_pair_reader::next_header_and_packed_data(std::string& chars,
+                                                  std::vector<std::uint64_t>& words,
+                                                  packed_sequence_layout& data1,
+                                                  packed_sequence_layout& data2)
+{
+    if (!has_next()) return index();
+
+    // only one sequence per call
+    if (singleMode_) {
+        const auto idx = reader1_->next_header_and_packed_data(
+                             &chars, data1, words, 0, chars);
+        data2.pack(data_type{}, words, data1.words_end(), chars);
+        return idx;
+    }
+
+    // pair = single sequences from 2 separate files (read in lockstep)
+    if (reader2_) {
+        reader1_->next_header_and_packed_data(&chars, data1, words, 0, chars);
+        return reader2_->next_header_and_packed_data(
+                   nullptr, data2, words, data1.words_end(), chars);
+    }
+
+    // pair = 2 consecutive sequences from same file
+    const auto idx = reader1_->index();
+    reader1_->next_header_and_packed_data(&chars, data1, words, 0, chars);
+    //make sure the index is only increased after the 2nd 'next()'
+    reader1_->index_offset(idx);
+    return reader1_->next_header_and_packed_data(
+               nullptr, data2, words, data1.words_end(), chars);
+}
+
+
+
 //-------------------------------------------------------------------
 void sequence_pair_reader::skip(index_type skip)
 {
@@ -31,8 +31,10 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "io_error.h"
+#include "packed_sequence.h"
 
 
 namespace mc {
@@ -98,6 +100,16 @@ public:
     /** @brief read next sequence data & header, re-uses external storage */
     index_type next_header_and_data(header_type&, data_type&);
 
+    /** @brief read next header (if not null) & sequence data;
+     *         the data is packed directly from the input into 'words'
+     *         starting at word index 'offset'
+     *         (see packed_sequence_layout::pack_from) */
+    index_type next_header_and_packed_data(header_type*,
+                                           packed_sequence_layout& data,
+                                           std::vector<std::uint64_t>& words,
+                                           std::size_t offset,
+                                           std::string& ambigChars);
+
 
     /** @brief skip n sequences */
     void skip(index_type n);
@@ -124,6 +136,10 @@ private:
 
     virtual void read_next(header_type*, data_type*, qualities_type*) = 0;
 
+    virtual void read_next_packed(header_type*, packed_sequence_layout&,
+                                  std::vector<std::uint64_t>&, std::size_t,
+                                  std::string&) = 0;
+
     virtual void skip_next() = 0;
 
     index_type index_;
@@ -150,12 +166,16 @@ private:
 
     void do_seek(std::streampos) override;
     void read_next(header_type*, data_type*, qualities_type*) override;
+    void read_next_packed(header_type*, packed_sequence_layout&,
+                          std::vector<std::uint64_t>&, std::size_t,
+                          std::string&) override;
     void skip_next() override;
 
 private:
     std::ifstream file_;
     std::string linebuffer_;
     std::streampos pos_;
+    std::vector<std::size_t> ambigPos_;
 };
 
 
@@ -178,12 +198,16 @@ private:
 
     void do_seek(std::streampos) override;
     void read_next(header_type*, data_type*, qualities_type*) override;
+    void read_next_packed(header_type*, packed_sequence_layout&,
+                          std::vector<std::uint64_t>&, std::size_t,
+                          std::string&) override;
     void skip_next() override;
 
 private:
     std::ifstream file_;
     std::string linebuffer_;
     std::streampos pos_;
+    std::vector<std::size_t> ambigPos_;
 };
 
 
@@ -243,6 +267,15 @@ public:
                                     sequence::data_type&,
                                     sequence::data_type&);
 
+    /** @brief read next header from 1st sequence and pack data from both
+               sequences directly from the input into 'words';
+               'chars' receives the header followed by all
+               ambiguous characters of both sequences */
+    index_type next_header_and_packed_data(std::string& chars,
+                                           std::vector<std::uint64_t>& words,
+                                           packed_sequence_layout& data1,
+                                           packed_sequence_layout& data2);
+
 
     /** @brief skip n sequences */
     void skip(index_type n);
@@ -0,0 +1,252 @@
+/******************************************************************************
+ *
+ * RmapAlign3N - 3N Read Mapping and Alignment Tool
+ *
+ * Copyright (C) 2024 André Müller (muellan@uni-mainz.de)
+ *                       
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#ifndef RMA_SEQUENCE_MASKING_H_
+#define RMA_SEQUENCE_MASKING_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+#include "options.h"
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief masks low-complexity regions of reference sequences
+ *        by replacing nucleotides with 'N';
+ *        k-mers with ambiguous characters are never sketched,
+ *        so masked regions don't produce any features
+ *
+ *        DUST: Sequences are scanned with windows of 'dustWindow' length
+ *        that overlap by half a window. The triplet score of a region is
+ *            10 * sum_t c_t(c_t - 1)/2 / (l - 1)
+ *        where c_t is the number of occurrences of triplet t and
+ *        l is the number of triplets in the region. If the score of a
+ *        window exceeds 'dustLevel', its highest-scoring sub-region is masked.
+ *        Triplets are counted on the original (unconverted) sequence,
+ *        since the 3N conversion lowers the complexity of all sequences.
+ *
+ *        Soft-masking: lower case nucleotides are masked.
+ *
+ *****************************************************************************/
+class sequence_masker
+{
+public:
+    using size_type = sequence::size_type;
+
+    //---------------------------------------------------------------
+    explicit
+    sequence_masker(const masking_options& opt):
+        dust_{opt.dust}, softMasked_{opt.softMasked},
+        level_{std::max(1, opt.dustLevel)},
+        window_{size_type(std::max(4, opt.dustWindow))}
+    {}
+
+
+    //---------------------------------------------------------------
+    bool active() const noexcept { return dust_ || softMasked_; }
+
+    explicit operator bool() const noexcept { return active(); }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @return number of masked nucleotides
+     */
+    size_type operator () (sequence& seq) const
+    {
+        size_type masked = 0;
+        if (softMasked_) masked += mask_lower_case(seq);
+        if (dust_)       masked += mask_dust(seq);
+        return masked;
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    static size_type
+    mask_lower_case(sequence& seq) noexcept
+    {
+        size_type masked = 0;
+        for (auto& c : seq) {
+            if (c >= 'a' && c <= 'z') {
+                c = 'N';
+                ++masked;
+            }
+        }
+        return masked;
+    }
+
+
+    //---------------------------------------------------------------
+    /// @return 2-bit code; 4 for ambiguous characters
+    static std::uint8_t code(char c) noexcept
+    {
+        switch (c) {
+            case 'A': case 'a': return 0;
+            case 'C': case 'c': return 1;
+            case 'G': case 'g': return 2;
+            case 'T': case 't': return 3;
+            default:  return 4;
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief calls 'consume(i, sum, l)' for each position i in [first,last)
+     *        that ends a triplet; 'sum' = sum_t c_t(c_t - 1)/2 and
+     *        'l' = number of triplets of region [first,i]
+     */
+    template<class Consumer>
+    static void
+    for_each_triplet_score(const sequence& seq, size_type first, size_type last,
+                           Consumer&& consume)
+    {
+        std::array<std::uint32_t,64> counts;
+        counts.fill(0);
+
+        std::uint64_t sum = 0;
+        size_type triplets = 0;
+        unsigned t = 0;
+        size_type valid = 0;   // number of preceding unambiguous nucleotides
+
+        for (size_type i = first; i < last; ++i) {
+            const auto c = code(seq[i]);
+            if (c > 3) { valid = 0; continue; }
+            t = ((t << 2) | c) & 63u;
+            if (++valid >= 3) {
+                // c(c-1)/2 summed incrementally
+                sum += counts[t]++;
+                ++triplets;
+                consume(i, sum, triplets);
+            }
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    bool exceeds_level(std::uint64_t sum, size_type triplets) const noexcept {
+        return triplets > 1 &&
+               10 * sum > std::uint64_t(level_) * (triplets - 1);
+    }
+
+
+    //---------------------------------------------------------------
+    /// @return highest-scoring sub-region of [first,last) or empty region
+    std::pair<size_type,size_type>
+    best_region(const sequence& seq, size_type first, size_type last) const
+    {
+        std::pair<size_type,size_type> best {first, first};
+        // compare sum_a / (l_a - 1) > sum_b / (l_b - 1) without division
+        std::uint64_t bestSum = 0;
+        size_type bestDiv = 1;
+
+        for (auto beg = first; beg + 2 < last; ++beg) {
+            for_each_triplet_score(seq, beg, last,
+                [&] (size_type i, std::uint64_t sum, size_type triplets) {
+                    if (exceeds_level(sum, triplets) &&
+                        sum * bestDiv > bestSum * (triplets - 1))
+                    {
+                        bestSum = sum;
+                        bestDiv = triplets - 1;
+                        best = {beg, i + 1};
+                    }
+                });
+        }
+        return best;
+    }
+
+
+    //---------------------------------------------------------------
+    size_type mask_dust(sequence& seq) const
+    {
+        const auto n = seq.size();
+        if (n < 3) return 0;
+
+        const auto w = std::min(window_, n);
+        const auto step = std::max(size_type(1), w / 2);
+
+        // collect all windows first, so that masking doesn't
+        // influence the scores of overlapping windows
+        std::vector<std::pair<size_type,size_type>> intervals;
+
+        for (size_type first = 0; ; first += step) {
+            // last window is aligned with the end of the sequence
+            if (first + w > n) first = n - w;
+            const auto last = first + w;
+
+            std::uint64_t sum = 0;
+            size_type triplets = 0;
+            for_each_triplet_score(seq, first, last,
+                [&] (size_type, std::uint64_t s, size_type l) {
+                    sum = s;
+                    triplets = l;
+                });
+
+            if (exceeds_level(sum, triplets)) {
+                const auto region = best_region(seq, first, last);
+                if (region.first < region.second) {
+                    if (!intervals.empty() &&
+                        intervals.back().second >= region.first)
+                    {
+                        intervals.back().second = std::max(
+                            intervals.back().second, region.second);
+                    } else {
+                        intervals.push_back(region);
+                    }
+                }
+            }
+            if (last >= n) break;
+        }
+
+        size_type masked = 0;
+        for (const auto& iv : intervals) {
+            for (auto i = iv.first; i < iv.second; ++i) {
+                if (code(seq[i]) < 4) {
+                    seq[i] = 'N';
+                    ++masked;
+                }
+            }
+        }
+        return masked;
+    }
+
+
+    //---------------------------------------------------------------
+    bool dust_;
+    bool softMasked_;
+    int level_;
+    size_type window_;
+};
+
+
+} // namespace mc
+
+
+#endif
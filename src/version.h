@@ -26,7 +26,9 @@
 
 #define RMA_VERSION 20241004
 
-#define RMA_DB_VERSION 20241004
+#define RMA_DB_VERSION 20261018
+
+#define RMA_CHECKPOINT_VERSION 20241004
 
 #define RMA_VERSION_STRING "0.1.0"
 